@@ -0,0 +1,766 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "heap.h"
+#include "number.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Contiguous backing store of an array variable. Arrays passed to or returned from
+// functions share their elements until one side writes, see array_make_unique.
+struct Array
+{
+    size_t length; // Number of elements
+    size_t capacity; // Elements data has room for, push grows it geometrically
+    number_kind kind; // Element type, narrow elements are packed
+    void *data; // Elements, zero initialized, may be shared with other arrays
+};
+
+static void free_array(void *object)
+{
+    heap_release(((struct Array *) object)->data);
+}
+
+// Constructor method for Array struct, the array and its elements live on the heap
+static struct Array *new_array(size_t length, number_kind kind)
+{
+    heap_reserve(sizeof(struct Array) + length * number_size(kind));
+    struct Array *_array = heap_alloc(sizeof(struct Array), false, free_array);
+    _array->length = length;
+    _array->capacity = length;
+    _array->kind = kind;
+    _array->data = heap_alloc(length * number_size(kind), true, NULL);
+    return _array;
+}
+
+// New array with the same elements as source, they are only copied once either is written
+static struct Array *array_share(struct Array const *source)
+{
+    struct Array *_array = heap_alloc(sizeof(struct Array), false, free_array);
+    _array->length = source->length;
+    _array->capacity = source->capacity;
+    _array->kind = source->kind;
+    _array->data = source->data;
+    heap_retain(_array->data);
+    return _array;
+}
+
+// Give the array its own copy of the elements before it is written if they are shared
+static void array_make_unique(struct Array *_array)
+{
+    if (heap_refcount(_array->data) > 1) {
+        void *data = heap_alloc(_array->length * number_size(_array->kind), false, NULL);
+        memcpy(data, _array->data, _array->length * number_size(_array->kind));
+        heap_release(_array->data);
+        _array->data = data;
+        _array->capacity = _array->length;
+    }
+}
+
+// Make room for capacity elements so the array can grow that far without moving
+static void array_reserve(struct Array *_array, size_t capacity)
+{
+    array_make_unique(_array);
+    if (capacity > _array->capacity) {
+        _array->data = heap_resize(_array->data, capacity * number_size(_array->kind));
+        _array->capacity = capacity;
+    }
+}
+
+// Whether i is the index of an element
+static bool array_has(struct Array const *_array, uint64_t i)
+{
+    return i < _array->length;
+}
+
+// Element i, which must be below the length, see array_has
+static uint64_t array_get(struct Array const *_array, size_t i)
+{
+    return number_load(_array->data, _array->kind, i);
+}
+
+// Store value, which must fit the element kind, at i, which must be below the length
+static void array_set(struct Array *_array, size_t i, uint64_t value)
+{
+    number_store(_array->data, _array->kind, i, value);
+}
+
+// Append value, doubling the room when it runs out so a run of pushes takes amortized constant time
+static void array_push(struct Array *_array, uint64_t value)
+{
+    if (_array->length == _array->capacity || heap_refcount(_array->data) > 1) {
+        array_reserve(_array, _array->length < 4 ? 8 : _array->length * 2);
+    }
+    array_set(_array, _array->length++, value);
+}
+
+// Change the number of elements, new ones are 0. Shrinking keeps the room for growing back.
+static void array_resize(struct Array *_array, size_t length)
+{
+    if (length > _array->length) {
+        array_reserve(_array, length > _array->capacity && length < _array->capacity * 2 ? _array->capacity * 2 : length);
+        size_t size = number_size(_array->kind);
+        memset((char *) _array->data + _array->length * size, 0, (length - _array->length) * size);
+    }
+    _array->length = length;
+}
+
+// Scalar kernels, used when the CPU has no AVX2
+
+static void fill_scalar(uint64_t *data, size_t len, uint64_t value)
+{
+    for (size_t i = 0; i < len; i++) {
+        data[i] = value;
+    }
+}
+
+static uint64_t sum_scalar(uint64_t const *data, size_t len)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < len; i++) {
+        total += data[i];
+    }
+    return total;
+}
+
+static uint64_t min_scalar(uint64_t const *data, size_t len)
+{
+    uint64_t best = UINT64_MAX;
+    for (size_t i = 0; i < len; i++) {
+        best = data[i] < best ? data[i] : best;
+    }
+    return best;
+}
+
+static uint64_t max_scalar(uint64_t const *data, size_t len)
+{
+    uint64_t best = 0;
+    for (size_t i = 0; i < len; i++) {
+        best = data[i] > best ? data[i] : best;
+    }
+    return best;
+}
+
+static uint64_t count_scalar(uint64_t const *data, size_t len, uint64_t value)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < len; i++) {
+        total += data[i] == value;
+    }
+    return total;
+}
+
+static size_t index_of_scalar(uint64_t const *data, size_t len, uint64_t value)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == value) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#if defined(__x86_64__)
+
+// AVX2 kernels, 4 elements per instruction with a scalar tail
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint64_t *data, size_t len, uint64_t value)
+{
+    __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        _mm256_storeu_si256((__m256i *) (data + i), v);
+    }
+    fill_scalar(data + i, len - i, value);
+}
+
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(uint64_t const *data, size_t len)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256((__m256i const *) (data + i)));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(data + i, len - i);
+}
+
+// AVX2 only compares signed lanes, flipping the sign bit orders unsigned values the same way
+__attribute__((target("avx2")))
+static uint64_t min_avx2(uint64_t const *data, size_t len)
+{
+    __m256i const sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i best = _mm256_set1_epi64x(INT64_MAX); // UINT64_MAX with the sign bit flipped
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((__m256i const *) (data + i)), sign);
+        best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(best, v));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_xor_si256(best, sign));
+    uint64_t ans = min_scalar(data + i, len - i);
+    for (int j = 0; j < 4; j++) {
+        ans = lanes[j] < ans ? lanes[j] : ans;
+    }
+    return ans;
+}
+
+__attribute__((target("avx2")))
+static uint64_t max_avx2(uint64_t const *data, size_t len)
+{
+    __m256i const sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i best = sign; // 0 with the sign bit flipped
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((__m256i const *) (data + i)), sign);
+        best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(v, best));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_xor_si256(best, sign));
+    uint64_t ans = max_scalar(data + i, len - i);
+    for (int j = 0; j < 4; j++) {
+        ans = lanes[j] > ans ? lanes[j] : ans;
+    }
+    return ans;
+}
+
+// Matching lanes compare to -1, so subtracting the mask counts them
+__attribute__((target("avx2")))
+static uint64_t count_avx2(uint64_t const *data, size_t len, uint64_t value)
+{
+    __m256i v = _mm256_set1_epi64x(value);
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i const *) (data + i)), v);
+        acc = _mm256_sub_epi64(acc, eq);
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + count_scalar(data + i, len - i, value);
+}
+
+__attribute__((target("avx2")))
+static size_t index_of_avx2(uint64_t const *data, size_t len, uint64_t value)
+{
+    __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i const *) (data + i)), v);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + index_of_scalar(data + i, len - i, value);
+}
+
+#endif
+
+// Operand of an element-wise loop statement: an array, a repeated value, or the loop index itself
+typedef enum {operand_array, operand_scalar, operand_index} operand_kind;
+
+struct Operand
+{
+    operand_kind kind;
+    uint64_t const *data; // Elements, for operand_array
+    uint64_t value; // Repeated value, or the first index for operand_index
+};
+
+static uint64_t operand_at(struct Operand const *operand, size_t i)
+{
+    if (operand->kind == operand_array) {
+        return operand->data[i];
+    } else if (operand->kind == operand_index) {
+        return operand->value + i;
+    }
+    return operand->value;
+}
+
+// dst[i] = a[i] op b[i] where op is '+', '-', '*', or 0 to just copy a
+static void map_scalar(uint64_t *dst, struct Operand a, struct Operand b, char op, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint64_t x = operand_at(&a, i);
+        uint64_t y = operand_at(&b, i);
+
+        if (op == '+') {
+            dst[i] = x + y;
+        } else if (op == '-') {
+            dst[i] = x - y;
+        } else if (op == '*') {
+            dst[i] = x * y;
+        } else {
+            dst[i] = x;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static inline __m256i operand_avx2(struct Operand const *operand, size_t i)
+{
+    if (operand->kind == operand_array) {
+        return _mm256_loadu_si256((__m256i const *) (operand->data + i));
+    } else if (operand->kind == operand_index) {
+        return _mm256_add_epi64(_mm256_set1_epi64x(operand->value + i), _mm256_setr_epi64x(0, 1, 2, 3));
+    }
+    return _mm256_set1_epi64x(operand->value);
+}
+
+// AVX2 has no 64-bit multiply, build it from 32-bit halves
+__attribute__((target("avx2")))
+static inline __m256i mullo_epi64_avx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static void map_avx2(uint64_t *dst, struct Operand a, struct Operand b, char op, size_t len)
+{
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256i x = operand_avx2(&a, i);
+        __m256i y = operand_avx2(&b, i);
+
+        if (op == '+') {
+            x = _mm256_add_epi64(x, y);
+        } else if (op == '-') {
+            x = _mm256_sub_epi64(x, y);
+        } else if (op == '*') {
+            x = mullo_epi64_avx2(x, y);
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), x);
+    }
+
+    // Scalar tail, operands continue from where the vector loop stopped
+    if (a.kind == operand_array) {
+        a.data += i;
+    } else if (a.kind == operand_index) {
+        a.value += i;
+    }
+    if (b.kind == operand_array) {
+        b.data += i;
+    } else if (b.kind == operand_index) {
+        b.value += i;
+    }
+    map_scalar(dst + i, a, b, op, len - i);
+}
+
+#endif
+
+// Float kernels over arrays of doubles. Sums keep 8 running totals, element i goes to total
+// i % 8 and the totals are added pairwise at the end, so the scalar and AVX2 versions add in
+// the same order and a result doesn't depend on the CPU it was computed on.
+
+#define LOG2E 1.44269504088896338700e+00
+#define LN2_HI 6.93147180369123816490e-01 // ln 2 in its upper bits, n * LN2_HI is exact
+#define LN2_LO 1.90821492927058770002e-10 // The rest of ln 2
+
+static double add_lanes(double const lanes[8])
+{
+    return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+}
+
+static double float_sum_scalar(double const *data, size_t len)
+{
+    double lanes[8] = {0};
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            lanes[j] += data[i + j];
+        }
+    }
+    double total = add_lanes(lanes);
+    for (; i < len; i++) {
+        total += data[i];
+    }
+    return total;
+}
+
+static double dot_scalar(double const *a, double const *b, size_t len)
+{
+    double lanes[8] = {0};
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            lanes[j] += a[i + j] * b[i + j];
+        }
+    }
+    double total = add_lanes(lanes);
+    for (; i < len; i++) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+// Sum of (data[i] - mean)^2, for the variance
+static double square_deviation_scalar(double const *data, size_t len, double mean)
+{
+    double lanes[8] = {0};
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            double d = data[i + j] - mean;
+            lanes[j] += d * d;
+        }
+    }
+    double total = add_lanes(lanes);
+    for (; i < len; i++) {
+        double d = data[i] - mean;
+        total += d * d;
+    }
+    return total;
+}
+
+static void sqrt_scalar(double *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        data[i] = sqrt(data[i]);
+    }
+}
+
+// e^x as 2^n * e^r with n = round(x / ln 2), so r is within ln 2 / 2 of 0 and a Taylor
+// series to r^13 is exact to the last bit or so. Results that overflow or are subnormal
+// come from the C library, which the AVX2 kernel also does for those lanes.
+static double exp_kernel(double x)
+{
+    if (!(x >= -708 && x <= 709)) {
+        return exp(x);
+    }
+
+    double n = nearbyint(x * LOG2E);
+    double r = (x - n * LN2_HI) - n * LN2_LO;
+    double p = 1.0 / 6227020800;
+    p = p * r + 1.0 / 479001600;
+    p = p * r + 1.0 / 39916800;
+    p = p * r + 1.0 / 3628800;
+    p = p * r + 1.0 / 362880;
+    p = p * r + 1.0 / 40320;
+    p = p * r + 1.0 / 5040;
+    p = p * r + 1.0 / 720;
+    p = p * r + 1.0 / 120;
+    p = p * r + 1.0 / 24;
+    p = p * r + 1.0 / 6;
+    p = p * r + 1.0 / 2;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    uint64_t bits = (uint64_t) ((int64_t) n + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+static void exp_scalar(double *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        data[i] = exp_kernel(data[i]);
+    }
+}
+
+#if defined(__x86_64__)
+
+// Adds the 2 vectors of running totals like add_lanes
+__attribute__((target("avx2")))
+static inline double add_lanes_avx2(__m256d low, __m256d high)
+{
+    double lanes[8];
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+    return add_lanes(lanes);
+}
+
+__attribute__((target("avx2")))
+static double float_sum_avx2(double const *data, size_t len)
+{
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        low = _mm256_add_pd(low, _mm256_loadu_pd(data + i));
+        high = _mm256_add_pd(high, _mm256_loadu_pd(data + i + 4));
+    }
+    double total = add_lanes_avx2(low, high);
+    for (; i < len; i++) {
+        total += data[i];
+    }
+    return total;
+}
+
+// Multiply and add stay separate instructions, a fused one would round differently than the scalar kernel
+__attribute__((target("avx2")))
+static double dot_avx2(double const *a, double const *b, size_t len)
+{
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double total = add_lanes_avx2(low, high);
+    for (; i < len; i++) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static double square_deviation_avx2(double const *data, size_t len, double mean)
+{
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(data + i), m);
+        __m256d e = _mm256_sub_pd(_mm256_loadu_pd(data + i + 4), m);
+        low = _mm256_add_pd(low, _mm256_mul_pd(d, d));
+        high = _mm256_add_pd(high, _mm256_mul_pd(e, e));
+    }
+    double total = add_lanes_avx2(low, high);
+    for (; i < len; i++) {
+        double d = data[i] - mean;
+        total += d * d;
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static void sqrt_avx2(double *data, size_t len)
+{
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        _mm256_storeu_pd(data + i, _mm256_sqrt_pd(_mm256_loadu_pd(data + i)));
+    }
+    sqrt_scalar(data + i, len - i);
+}
+
+// exp_kernel on 4 lanes at once
+__attribute__((target("avx2")))
+static void exp_avx2(double *data, size_t len)
+{
+    // Adding 1.5 * 2^52 puts a whole double's integer value in the low bits
+    __m256d const shift = _mm256_set1_pd(6755399441055744.0);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m256d x = _mm256_loadu_pd(data + i);
+        __m256d inRange = _mm256_and_pd(_mm256_cmp_pd(x, _mm256_set1_pd(-708), _CMP_GE_OQ), _mm256_cmp_pd(x, _mm256_set1_pd(709), _CMP_LE_OQ));
+        int outside = ~_mm256_movemask_pd(inRange) & 0xF;
+
+        __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_HI))), _mm256_mul_pd(n, _mm256_set1_pd(LN2_LO)));
+        __m256d p = _mm256_set1_pd(1.0 / 6227020800);
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 479001600));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 39916800));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 3628800));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 362880));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 40320));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 5040));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 720));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 120));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 24));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 6));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 2));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0));
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0));
+
+        __m256i exponent = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(n, shift)), _mm256_castpd_si256(shift));
+        __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(exponent, _mm256_set1_epi64x(1023)), 52));
+        __m256d y = _mm256_mul_pd(p, scale);
+
+        if (outside != 0) {
+            double lanes[4];
+            _mm256_storeu_pd(lanes, y);
+            for (int j = 0; j < 4; j++) {
+                if (outside & (1 << j)) {
+                    lanes[j] = exp(data[i + j]);
+                }
+            }
+            y = _mm256_loadu_pd(lanes);
+        }
+        _mm256_storeu_pd(data + i, y);
+    }
+    exp_scalar(data + i, len - i);
+}
+
+#endif
+
+// Kernels picked once at startup for the running CPU
+static void (*array_fill)(uint64_t *data, size_t len, uint64_t value) = fill_scalar;
+static uint64_t (*array_sum)(uint64_t const *data, size_t len) = sum_scalar;
+static uint64_t (*array_min)(uint64_t const *data, size_t len) = min_scalar;
+static uint64_t (*array_max)(uint64_t const *data, size_t len) = max_scalar;
+static uint64_t (*array_count)(uint64_t const *data, size_t len, uint64_t value) = count_scalar;
+static size_t (*array_index_of)(uint64_t const *data, size_t len, uint64_t value) = index_of_scalar;
+static void (*array_map)(uint64_t *dst, struct Operand a, struct Operand b, char op, size_t len) = map_scalar;
+static double (*array_float_sum)(double const *data, size_t len) = float_sum_scalar;
+static double (*array_dot)(double const *a, double const *b, size_t len) = dot_scalar;
+static double (*array_square_deviation)(double const *data, size_t len, double mean) = square_deviation_scalar;
+static void (*array_sqrt)(double *data, size_t len) = sqrt_scalar;
+static void (*array_exp)(double *data, size_t len) = exp_scalar;
+
+static void init_array_kernels()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        array_fill = fill_avx2;
+        array_sum = sum_avx2;
+        array_min = min_avx2;
+        array_max = max_avx2;
+        array_count = count_avx2;
+        array_index_of = index_of_avx2;
+        array_map = map_avx2;
+        array_float_sum = float_sum_avx2;
+        array_dot = dot_avx2;
+        array_square_deviation = square_deviation_avx2;
+        array_sqrt = sqrt_avx2;
+        array_exp = exp_avx2;
+    }
+#endif
+}
+
+// Whole-array operations for every element kind. Results that don't depend on the sign of
+// 64 bit elements come from the kernels above, the rest are plain loops. Float elements and
+// results are the bits of doubles.
+
+static void typed_fill(struct Array *_array, uint64_t value)
+{
+    if (number_size(_array->kind) == sizeof(uint64_t)) {
+        array_fill(_array->data, _array->length, value);
+    } else if (number_size(_array->kind) == 1) {
+        memset(_array->data, (uint8_t) value, _array->length);
+    } else {
+        for (size_t i = 0; i < _array->length; i++) {
+            array_set(_array, i, value);
+        }
+    }
+}
+
+static uint64_t typed_sum(struct Array const *_array)
+{
+    if (_array->kind == float64) {
+        return number_from_double(array_float_sum(_array->data, _array->length)).value;
+    }
+    if (number_size(_array->kind) == sizeof(uint64_t)) {
+        return array_sum(_array->data, _array->length);
+    }
+    uint64_t total = 0;
+    for (size_t i = 0; i < _array->length; i++) {
+        total += array_get(_array, i);
+    }
+    return total;
+}
+
+// Smallest element, or the largest with largest set. 0 for an empty array.
+static uint64_t typed_extreme(struct Array const *_array, bool largest)
+{
+    if (_array->length == 0) {
+        return 0;
+    }
+    if (_array->kind == uint64) {
+        return largest ? array_max(_array->data, _array->length) : array_min(_array->data, _array->length);
+    }
+    if (_array->kind == float64) {
+        double const *data = _array->data;
+        double best = data[0];
+        for (size_t i = 1; i < _array->length; i++) {
+            best = (largest ? data[i] > best : data[i] < best) ? data[i] : best;
+        }
+        return number_from_double(best).value;
+    }
+
+    // Every other kind compares as int64_t
+    int64_t best = array_get(_array, 0);
+    for (size_t i = 1; i < _array->length; i++) {
+        int64_t v = array_get(_array, i);
+        best = (largest ? v > best : v < best) ? v : best;
+    }
+    return best;
+}
+
+static uint64_t typed_count(struct Array const *_array, uint64_t value)
+{
+    if (_array->kind == float64) {
+        double const *data = _array->data;
+        double v = number_as_double(number_of(value, float64));
+        uint64_t n = 0;
+        for (size_t i = 0; i < _array->length; i++) {
+            n += data[i] == v;
+        }
+        return n;
+    }
+    if (number_size(_array->kind) == sizeof(uint64_t)) {
+        return array_count(_array->data, _array->length, value);
+    }
+    uint64_t n = 0;
+    if (number_fits(_array->kind, value)) {
+        for (size_t i = 0; i < _array->length; i++) {
+            n += array_get(_array, i) == value;
+        }
+    }
+    return n;
+}
+
+// Position of the first element equal to value, the length if there is none
+static size_t typed_index_of(struct Array const *_array, uint64_t value)
+{
+    if (_array->kind == float64) {
+        double const *data = _array->data;
+        double v = number_as_double(number_of(value, float64));
+        for (size_t i = 0; i < _array->length; i++) {
+            if (data[i] == v) {
+                return i;
+            }
+        }
+        return _array->length;
+    }
+    if (number_size(_array->kind) == sizeof(uint64_t)) {
+        return array_index_of(_array->data, _array->length, value);
+    }
+    if (number_fits(_array->kind, value)) {
+        for (size_t i = 0; i < _array->length; i++) {
+            if (array_get(_array, i) == value) {
+                return i;
+            }
+        }
+    }
+    return _array->length;
+}
+
+// Copy the first n elements of src into dst, which must be unique. False if one doesn't fit
+// the element kind of dst, the elements before it have been copied by then.
+static bool typed_copy(struct Array *dst, struct Array const *src, size_t n)
+{
+    if (dst->kind == src->kind) {
+        memmove(dst->data, src->data, n * number_size(dst->kind));
+        return true;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t value;
+        if (!number_convert(number_of(array_get(src, i), src->kind), dst->kind, &value)) {
+            return false;
+        }
+        array_set(dst, i, value);
+    }
+    return true;
+}
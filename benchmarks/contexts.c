@@ -0,0 +1,118 @@
+// Runs the same script in one context per thread, for 1 thread up to one per core, and reports
+// runs per second and the speedup over a single thread. Contexts share nothing, so the speedup
+// should follow the number of threads until the cores run out.
+//
+//     gcc -O2 -I. -o contexts benchmarks/contexts.c fun.c -lm -pthread
+//     ./contexts [runs per thread] [most threads]
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fun.h"
+
+char const *const script =
+    "fun fib(n) {\n"
+    "    if (n < 2) {\n"
+    "        return n\n"
+    "    }\n"
+    "    return fib(n - 1) + fib(n - 2)\n"
+    "}\n"
+    "\n"
+    "fun work(seed) {\n"
+    "    integer a[0]\n"
+    "    for (integer i = 0; i < 2000; i = i + 1) {\n"
+    "        push(a, (i * seed) % 1009)\n"
+    "    }\n"
+    "    map m[0]\n"
+    "    for (integer i = 0; i < 500; i = i + 1) {\n"
+    "        m[a[i]] = i\n"
+    "    }\n"
+    "    return sum(a) + len(m) + fib(15)\n"
+    "}\n";
+
+struct Worker
+{
+    pthread_t thread;
+    int runs;
+    int failed;
+};
+
+double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *runWorker(void *arg)
+{
+    struct Worker *worker = arg;
+    fun_context *ctx = fun_new("contexts.fun");
+
+    if (fun_compile(ctx, script) != FUN_OK)
+    {
+        fputs(fun_error(ctx, NULL, NULL), stderr);
+        worker->failed = 1;
+    }
+
+    for (int i = 0; i < worker->runs && !worker->failed; i++)
+    {
+        fun_value seed = fun_int(i + 1);
+        fun_value result;
+        if (fun_call(ctx, "work", &seed, 1, &result) != FUN_OK)
+        {
+            fputs(fun_error(ctx, NULL, NULL), stderr);
+            worker->failed = 1;
+        }
+    }
+
+    fun_free(ctx);
+    return NULL;
+}
+
+// Seconds it takes threads threads to do runs runs each
+double timeThreads(int threads, int runs)
+{
+    struct Worker workers[threads];
+    double start = seconds();
+
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i] = (struct Worker) {0, runs, 0};
+        pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].failed)
+        {
+            exit(1);
+        }
+    }
+
+    return seconds() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+    int cores = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    double single = 0;
+
+    // Powers of 2, then every core
+    for (int threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2)
+    {
+        double time = timeThreads(threads, runs);
+        double rate = threads * runs / time;
+        if (threads == 1)
+        {
+            single = rate;
+        }
+        printf("%d threads: %.0f runs/s, %.2fx\n", threads, rate, rate / single);
+    }
+
+    return 0;
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+struct Function;
+
+// What a call in the program text resolved to. It holds while functionGeneration of the
+// program is still generation, a definition that changed since then may have freed func.
+struct CallSite
+{
+    struct Function *func; // NULL until the call first runs
+    char const *name; // Key of func in the function table
+    size_t generation;
+};
+
+// Operand of a simple expression
+typedef enum {expr_literal, expr_variable, expr_element} expr_operand_kind;
+
+struct ExprOperand
+{
+    expr_operand_kind kind;
+    uint32_t name; // Offset of the name of the variable or array
+    uint32_t nameLength;
+    uint32_t index; // Offset of the name of the variable an element is indexed by
+    uint32_t indexLength; // 0 if the index is value
+    uint64_t value; // A literal, or the literal index of an element
+};
+
+// Expression that is one operand, or two with an operator between them
+struct SimpleExpression
+{
+    char op; // + - * / %, < > = (==) ! (!=) l (<=) g (>=), 0 for a lone operand
+    struct ExprOperand left;
+    struct ExprOperand right;
+    uint32_t end; // Offset just past the expression and the blanks after it
+};
+
+// name = value, or name = name + step when end isn't 0
+struct Assignment
+{
+    uint32_t name; // Offset of the name of the variable
+    uint32_t nameLength;
+    uint32_t value; // Offset just past the =
+    uint64_t step; // Added to the variable, wrapping around, for a - the negated constant
+    uint32_t end; // Offset just past the value and the blanks after it, 0 if it isn't a step
+};
+
+// Header of for (integer induction = init; condition; target = update) {, where each part starts
+struct ForHeader
+{
+    uint32_t induction;
+    uint32_t inductionLength;
+    uint32_t init;
+    uint32_t condition;
+    uint32_t target;
+    uint32_t targetLength;
+    uint32_t update;
+    uint32_t body; // Just past the {
+};
+
+// Condition of an if or while that is a simple expression, followed by ) {
+struct Branch
+{
+    struct SimpleExpression condition;
+    uint32_t body; // Just past the {
+};
+
+typedef enum {site_pending, site_generic, site_expression, site_assignment, site_for, site_branch} site_kind;
+
+static char const *const site_kind_names[] = {"not fused yet", "parsed each time", "simple expression", "fused assignment", "fused for loop header", "fused compare and branch"};
+
+// Statement or expression that ran, by where it starts. Once it is picked, see fuseNow in
+// interpreter.h, it is worked out and, if it has one of the shapes above, later runs skip
+// parsing it. See fastSite in interpreter.h.
+struct FastSite
+{
+    site_kind kind;
+    bool hot; // Picked by --profile-guided from the runs of every site, see rankSites
+    uint32_t offset; // Where it starts in the program
+    uint64_t runs; // Times it ran, for FUSE_AFTER, --profile-guided and --profile
+    union {
+        struct SimpleExpression expression;
+        struct Assignment assignment;
+        struct ForHeader header;
+        struct Branch branch;
+    };
+};
+
+#define BRACE_FAST_SITE 0x80000000u // Marks a match entry that numbers a FastSite
+#define BRACE_SITE_BLOCK 64 // FastSites are allocated this many at a time, so they never move
+
+// Where the blocks of a program end, found in one pass before it runs. Skipping a block that
+// doesn't run, like a false if or a loop that is done, is then one lookup instead of counting
+// braces all the way to its end. Braces inside string literals don't count.
+struct BraceTable
+{
+    _Atomic size_t refcount; // A function shares its table with every call that is running it
+    size_t length; // Bytes of program text covered
+    uint32_t *match; // For the { at offset i the offset just past its }, for the name of a call the number of its site, for a statement or expression that ran BRACE_FAST_SITE and the number of its FastSite, 0 everywhere else
+    struct CallSite *sites; // Of every name followed by (, the first is unused
+    size_t siteCount;
+    struct FastSite **fastSites; // Blocks of BRACE_SITE_BLOCK
+    size_t fastCount;
+    size_t origin; // Offset of the program in the source, for --profile and streamed programs
+};
+
+// True if c can continue a name
+static bool brace_name_char(char c)
+{
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+// Offset of the closing quote of the string literal opening at i, length if it isn't closed
+static size_t brace_skip_string(char const *program, size_t length, size_t i)
+{
+    char const *end = memchr(program + i + 1, '"', length - i - 1);
+    return end != NULL ? (size_t) (end - program) : length;
+}
+
+// Table for the first length bytes of program. NULL if offsets don't fit 31 bits,
+// blocks are found by scanning then.
+static struct BraceTable *new_brace_table(char const *program, size_t length)
+{
+    if (length >= BRACE_FAST_SITE) {
+        return NULL;
+    }
+
+    struct BraceTable *table = malloc(sizeof(struct BraceTable));
+    atomic_init(&table->refcount, 1);
+    table->length = length;
+    table->match = calloc(length + 1, sizeof(uint32_t));
+
+    // Offsets of the braces still open, innermost last
+    size_t depth = 0;
+    size_t capacity = 16;
+    uint32_t *open = malloc(capacity * sizeof(uint32_t));
+
+    size_t siteCapacity = 16;
+    table->sites = malloc(siteCapacity * sizeof(struct CallSite));
+    table->siteCount = 1;
+    table->fastSites = NULL;
+    table->fastCount = 0;
+    table->origin = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        char const c = program[i];
+        if (c == '"') {
+            i = brace_skip_string(program, length, i);
+        } else if (c == '{') {
+            if (depth == capacity) {
+                capacity *= 2;
+                open = realloc(open, capacity * sizeof(uint32_t));
+            }
+            open[depth++] = i;
+        } else if (c == '}' && depth > 0) {
+            table->match[open[--depth]] = i + 1;
+        } else if ((isalpha((unsigned char) c) || c == '_') && (i == 0 || !brace_name_char(program[i - 1]))) {
+            // A name, which is a call when a ( follows. Keywords like while get a site they never
+            // use, but not if, whose statement has a FastSite at the same offset.
+            size_t end = i + 1;
+            while (end < length && brace_name_char(program[end])) {
+                end++;
+            }
+            size_t next = end;
+            while (next < length && (program[next] == ' ' || program[next] == '\t')) {
+                next++;
+            }
+            bool keywordIf = end - i == 2 && program[i] == 'i' && program[i + 1] == 'f';
+            if (next < length && program[next] == '(' && !keywordIf) {
+                if (table->siteCount == siteCapacity) {
+                    siteCapacity *= 2;
+                    table->sites = realloc(table->sites, siteCapacity * sizeof(struct CallSite));
+                }
+                table->sites[table->siteCount] = (struct CallSite) {NULL, NULL, 0};
+                table->match[i] = table->siteCount++;
+            }
+            i = end - 1;
+        }
+    }
+
+    free(open);
+    return table;
+}
+
+static struct BraceTable *brace_table_retain(struct BraceTable *table)
+{
+    if (table != NULL) {
+        atomic_fetch_add_explicit(&table->refcount, 1, memory_order_relaxed);
+    }
+    return table;
+}
+
+static void brace_table_release(struct BraceTable *table)
+{
+    if (table != NULL && atomic_fetch_sub_explicit(&table->refcount, 1, memory_order_acq_rel) == 1) {
+        free(table->match);
+        free(table->sites);
+        for (size_t i = 0; i < table->fastCount; i += BRACE_SITE_BLOCK) {
+            free(table->fastSites[i / BRACE_SITE_BLOCK]);
+        }
+        free(table->fastSites);
+        free(table);
+    }
+}
+
+// Offset just past the } that closes the { at offset, 0 if the table can't tell
+static size_t brace_match(struct BraceTable const *table, size_t offset)
+{
+    if (table == NULL || offset >= table->length) {
+        return 0;
+    }
+    return table->match[offset];
+}
+
+// Site of the call whose name starts at offset, NULL if there is none or the table can't tell
+static struct CallSite *brace_call_site(struct BraceTable *table, size_t offset)
+{
+    if (table == NULL || offset >= table->length || table->match[offset] == 0 || (table->match[offset] & BRACE_FAST_SITE) != 0) {
+        return NULL;
+    }
+    return &table->sites[table->match[offset]];
+}
+
+// FastSite number i
+static struct FastSite *brace_fast_site_at(struct BraceTable const *table, size_t i)
+{
+    return &table->fastSites[i / BRACE_SITE_BLOCK][i % BRACE_SITE_BLOCK];
+}
+
+// Site of the statement or expression at offset, which must be in the table. If nothing ran
+// there before a pending one is added when create is set. NULL if there is none, or if a call
+// starts at offset.
+static struct FastSite *brace_fast_site(struct BraceTable *table, size_t offset, bool create)
+{
+    uint32_t entry = table->match[offset];
+    if (entry != 0) {
+        return (entry & BRACE_FAST_SITE) != 0 ? brace_fast_site_at(table, entry & ~BRACE_FAST_SITE) : NULL;
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    if (table->fastCount % BRACE_SITE_BLOCK == 0) {
+        size_t blocks = table->fastCount / BRACE_SITE_BLOCK + 1;
+        table->fastSites = realloc(table->fastSites, blocks * sizeof(struct FastSite *));
+        table->fastSites[blocks - 1] = malloc(BRACE_SITE_BLOCK * sizeof(struct FastSite));
+    }
+    struct FastSite *site = brace_fast_site_at(table, table->fastCount);
+    site->kind = site_pending;
+    site->hot = false;
+    site->offset = offset;
+    site->runs = 0;
+    table->match[offset] = BRACE_FAST_SITE | table->fastCount++;
+    return site;
+}
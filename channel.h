@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "queue.h"
+#include "heap.h"
+
+// Slot of a channel's ring buffer, its sequence number says whose turn it is
+struct ChannelCell
+{
+    _Atomic size_t sequence;
+    uint64_t value;
+};
+
+// Bounded multi-producer multi-consumer queue of integers (Vyukov's ring buffer).
+// Sends and receives claim a slot with one compare-and-swap and never take a lock.
+struct Channel
+{
+    struct ChannelCell *buffer;
+    size_t mask; // Capacity - 1, the capacity is a power of 2
+    _Alignas(64) _Atomic size_t sendPos;
+    _Alignas(64) _Atomic size_t recvPos;
+    _Atomic bool closed;
+
+    Queue senders; // Coroutines sleeping until there is room
+    Queue receivers; // Coroutines sleeping until there is a value
+
+    pthread_mutex_t lock; // Held by parallel for workers while they wake coroutines
+};
+
+static void free_channel(void *object)
+{
+    struct Channel *channel = object;
+    free(channel->buffer);
+    pthread_mutex_destroy(&channel->lock);
+}
+
+// Constructor method for Channel struct, capacity is rounded up to a power of 2.
+// The ring needs at least 2 slots to tell a full slot from an empty one.
+static struct Channel *new_channel(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    struct Channel *channel = heap_alloc_aligned(sizeof(struct Channel), 64, free_channel);
+    channel->buffer = malloc(sizeof(struct ChannelCell) * size);
+    channel->mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&channel->buffer[i].sequence, i);
+    }
+
+    pthread_mutex_init(&channel->lock, NULL);
+
+    return channel;
+}
+
+// Add value to the channel, false if it is full
+static bool channel_try_send(struct Channel *channel, uint64_t value)
+{
+    size_t pos = atomic_load_explicit(&channel->sendPos, memory_order_relaxed);
+
+    while (true) {
+        struct ChannelCell *cell = &channel->buffer[pos & channel->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t) sequence - (intptr_t) pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&channel->sendPos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                cell->value = value;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&channel->sendPos, memory_order_relaxed);
+        }
+    }
+}
+
+// Take the oldest value from the channel, false if it is empty
+static bool channel_try_recv(struct Channel *channel, uint64_t *value)
+{
+    size_t pos = atomic_load_explicit(&channel->recvPos, memory_order_relaxed);
+
+    while (true) {
+        struct ChannelCell *cell = &channel->buffer[pos & channel->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&channel->recvPos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *value = cell->value;
+                atomic_store_explicit(&cell->sequence, pos + channel->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&channel->recvPos, memory_order_relaxed);
+        }
+    }
+}
+
+// Whether a send or receive could succeed now, used to decide whether to sleep
+static bool channel_has_room(struct Channel *channel)
+{
+    size_t recvPos = atomic_load(&channel->recvPos);
+    return atomic_load(&channel->sendPos) - recvPos <= channel->mask;
+}
+
+static bool channel_has_value(struct Channel *channel)
+{
+    return atomic_load(&channel->sendPos) != atomic_load(&channel->recvPos);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "queue.h"
+#include "source.h"
+#include "sandbox.h"
+#include "heap.h"
+
+// Everything one program owns: the functions it defined, its global scope, its source, the
+// coroutines it runs, its limits and its heap. The command line runs a single program, a host
+// embedding the interpreter through fun.h holds one context per program it loaded. context is
+// the one this thread runs, nothing reaches the state of another, so threads running different
+// programs don't share anything they change.
+struct Context
+{
+    struct FunctionPair **functions; // Functions by name, see function.h
+    size_t functionsSize; // Slots in functions
+    size_t functionGeneration; // Bumped whenever a definition changes, memo caches computed before then are stale
+
+    struct Interpreter *global; // Interpreter for global scope
+    struct SourceMap source; // Lines of every piece of source the program was given
+    struct Sandbox sandbox; // Limits of the program and what its run has left of them
+    struct Heap heap; // Live objects of the program
+    bool profiling; // Keep every brace table for --profile
+    bool guided; // Fuse the sites that run most, keeping every brace table too, see rankSites
+    struct BraceTable **profiled; // Tables kept, with the counters of what ran
+    size_t profiledCount;
+    uint64_t siteRuns; // Runs of every site so far, counted for guided
+    uint64_t nextRanking; // siteRuns at which guided picks the sites to fuse again
+    bool streaming; // Keep every brace table too, to tell which lines of the source are still needed, see forgetSource in main.c
+    struct BraceTable **streamed;
+    size_t streamedCount;
+
+    // Scheduler, see coroutine.h
+    Queue readyQ; // Coroutines that can run, in order
+    struct Interpreter *running; // Root interpreter of the running coroutine
+    struct Coroutine *zombie; // Finished coroutine whose stack can be released once we are off it
+    int epollFd;
+    int completionFd;
+    size_t ioWaiting; // Coroutines suspended until an fd or a helper thread job is ready
+    Queue completedQ;
+    pthread_mutex_t completedLock;
+};
+
+static __thread struct Context *context = NULL; // Program the thread is running
+
+static struct Heap *program_heap()
+{
+    return &context->heap;
+}
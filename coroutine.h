@@ -0,0 +1,301 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ucontext.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "queue.h"
+#include "heap.h"
+#include "context.h"
+
+#define COROUTINE_STACK_SIZE ((size_t) 64 << 20) // Reserved per coroutine, only touched pages are committed
+
+// Stack left when calls stop with error_depth, for the C code of the last call and the error report
+#define STACK_RESERVE (256 << 10)
+
+// Execution state of a coroutine, the interpreter at the root of its calls points to it.
+// The coroutine holds a reference to itself until it has finished, thread variables hold the others.
+struct Coroutine
+{
+    ucontext_t context; // Registers saved while it isn't running
+    void *stack;
+    bool finished;
+    uint64_t result; // Return value of the function it ran
+    Queue joiners; // Coroutines waiting in join() for this one
+};
+
+// The scheduler state belongs to the program, see context.h. Event loop: coroutines suspended on
+// I/O are woken from here instead of a wait queue. An fd registered with epoll carries its waiting
+// interpreter, the eventfd carries NULL and signals that helper threads have finished jobs for
+// the coroutines in completedQ.
+
+// The main program becomes the first coroutine
+static void init_scheduler(struct Interpreter *main)
+{
+    context->readyQ = (Queue) {NULL, NULL};
+    context->completedQ = (Queue) {NULL, NULL};
+    pthread_mutex_init(&context->completedLock, NULL);
+    context->ioWaiting = 0;
+    context->zombie = NULL;
+    main->coroutine = calloc(1, sizeof(struct Coroutine));
+    context->running = main;
+}
+
+static void init_event_loop()
+{
+    context->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    context->completionFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (context->epollFd < 0 || context->completionFd < 0) {
+        perror("epoll");
+        exit(1);
+    }
+
+    struct epoll_event event = {EPOLLIN, {.ptr = NULL}};
+    epoll_ctl(context->epollFd, EPOLL_CTL_ADD, context->completionFd, &event);
+}
+
+// Move coroutines whose I/O is ready to readyQ, waiting up to timeout milliseconds (-1 = forever)
+static void poll_io(int timeout)
+{
+    struct epoll_event events[64];
+    int n = epoll_wait(context->epollFd, events, 64, timeout);
+
+    for (int i = 0; i < n; i++) {
+        struct Interpreter *waiter = events[i].data.ptr;
+        if (waiter != NULL) {
+            context->ioWaiting--;
+            addQ(&context->readyQ, waiter);
+            continue;
+        }
+
+        uint64_t count;
+        if (read(context->completionFd, &count, sizeof(count)) < 0) {
+            continue;
+        }
+        pthread_mutex_lock(&context->completedLock);
+        while ((waiter = removeQ(&context->completedQ)) != NULL) {
+            context->ioWaiting--;
+            addQ(&context->readyQ, waiter);
+        }
+        pthread_mutex_unlock(&context->completedLock);
+    }
+}
+
+// Called by a helper thread when the job waiter of the program owner suspended on is done
+static void complete_io(struct Context *owner, struct Interpreter *waiter)
+{
+    uint64_t one = 1;
+    pthread_mutex_lock(&owner->completedLock);
+    addQ(&owner->completedQ, waiter);
+    pthread_mutex_unlock(&owner->completedLock);
+    if (write(owner->completionFd, &one, sizeof(one)) < 0) {
+        perror("eventfd");
+    }
+}
+
+// Next coroutine to run. Finished I/O is picked up on every switch so a busy
+// coroutine can't starve it, and we only block in epoll when nothing else can run.
+static struct Interpreter *next_ready()
+{
+    if (context->ioWaiting > 0) {
+        poll_io(context->readyQ.head == 0 ? -1 : 0);
+    }
+    return removeQ(&context->readyQ);
+}
+
+static void reap_zombie()
+{
+    if (context->zombie != NULL) {
+        munmap(context->zombie->stack, COROUTINE_STACK_SIZE);
+        context->zombie->stack = NULL;
+        heap_release(context->zombie);
+        context->zombie = NULL;
+    }
+}
+
+// Lowest address calls may use on the stack of the thread, see stack_exhausted
+static __thread char const *threadStackFloor = NULL;
+
+// Whether the running code got within STACK_RESERVE of the end of its stack, the stack of the
+// running coroutine or, in the main coroutine and parallel for workers, that of the thread
+static bool stack_exhausted()
+{
+    char const *here = __builtin_frame_address(0);
+    struct Coroutine *coroutine = context->running != NULL ? context->running->coroutine : NULL;
+
+    if (coroutine != NULL && coroutine->stack != NULL && here >= (char const *) coroutine->stack &&
+        here < (char const *) coroutine->stack + COROUTINE_STACK_SIZE) {
+        return here < (char const *) coroutine->stack + sysconf(_SC_PAGESIZE) + STACK_RESERVE;
+    }
+
+    if (threadStackFloor == NULL) {
+        pthread_attr_t attr;
+        void *start = NULL;
+        size_t size;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+            return false;
+        }
+        pthread_attr_getstack(&attr, &start, &size);
+        pthread_attr_destroy(&attr);
+        threadStackFloor = (char const *) start + STACK_RESERVE;
+    }
+    return here < threadStackFloor;
+}
+
+// Create a coroutine that starts in entry and queue it to run
+static struct Coroutine *new_coroutine(struct Interpreter *_interpreter, void (*entry)(void))
+{
+    struct Coroutine *coroutine = heap_alloc(sizeof(struct Coroutine), true, NULL);
+
+    coroutine->stack = mmap(0, COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (coroutine->stack == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    // Guard page so an overflow faults instead of corrupting memory
+    mprotect(coroutine->stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+
+    getcontext(&coroutine->context);
+    coroutine->context.uc_stack.ss_sp = coroutine->stack;
+    coroutine->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    coroutine->context.uc_link = NULL;
+    makecontext(&coroutine->context, entry, 0);
+
+    _interpreter->coroutine = coroutine;
+    addQ(&context->readyQ, _interpreter);
+
+    return coroutine;
+}
+
+// Switch to the next ready coroutine, false if there is none
+static bool switch_to_next()
+{
+    struct Interpreter *next = next_ready();
+    if (next == NULL) {
+        return false;
+    }
+
+    struct Interpreter *prev = context->running;
+    struct Interpreter *scope = runningScope; // Each coroutine runs statements of its own
+    context->running = next;
+    swapcontext(&prev->coroutine->context, &next->coroutine->context);
+    runningScope = scope;
+
+    reap_zombie();
+    return true;
+}
+
+// Let the other ready coroutines run before continuing
+static void yield_coroutine()
+{
+    if (context->ioWaiting > 0) {
+        poll_io(0);
+    }
+    if (context->readyQ.head != 0) {
+        addQ(&context->readyQ, context->running);
+        switch_to_next();
+    }
+}
+
+// Sleep on waiters until woken, false if every coroutine would be asleep
+static bool park(Queue *waiters)
+{
+    addQ(waiters, context->running);
+    return switch_to_next();
+}
+
+// Sleep until fd is ready for events (EPOLLIN or EPOLLOUT).
+// Returns false if fd can't be watched, regular files are always ready.
+static bool wait_fd(int fd, uint32_t events)
+{
+    struct epoll_event event = {events | EPOLLONESHOT, {.ptr = context->running}};
+    if (epoll_ctl(context->epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return false;
+    }
+
+    context->ioWaiting++;
+    switch_to_next();
+    epoll_ctl(context->epollFd, EPOLL_CTL_DEL, fd, NULL);
+    return true;
+}
+
+// Sleep until a helper thread passes the running coroutine to complete_io
+static void wait_job()
+{
+    context->ioWaiting++;
+    switch_to_next();
+}
+
+// Where wake puts the coroutines it wakes, NULL for context->readyQ. The workers of a parallel
+// for each collect them in a queue of their own, which readyQ gets once the loop is done.
+static __thread Queue *wokenQ = NULL;
+
+// Make the first coroutine sleeping on waiters ready again
+static void wake(Queue *waiters)
+{
+    struct Interpreter *r = removeQ(waiters);
+    if (r != 0) {
+        addQ(wokenQ != NULL ? wokenQ : &context->readyQ, r);
+    }
+}
+
+static void wake_all(Queue *waiters)
+{
+    while (waiters->head != 0) {
+        wake(waiters);
+    }
+}
+
+// Finish the running coroutine with result and never come back to it.
+// Returns only if no coroutine is ready to take over.
+static bool exit_coroutine(uint64_t result)
+{
+    struct Coroutine *coroutine = context->running->coroutine;
+    coroutine->finished = true;
+    coroutine->result = result;
+    wake_all(&coroutine->joiners);
+
+    struct Interpreter *next = next_ready();
+    if (next == NULL) {
+        return false;
+    }
+
+    free_interpreter(context->running);
+    context->zombie = coroutine;
+    context->running = next;
+    setcontext(&next->coroutine->context);
+    return false;
+}
+
+// Drop the coroutine that runs from root after an error unwound off its stack. Its joiners get 0.
+static void abandon_coroutine(struct Interpreter *root)
+{
+    struct Coroutine *coroutine = root->coroutine;
+    coroutine->finished = true;
+    coroutine->result = 0;
+    wake_all(&coroutine->joiners);
+
+    free_interpreter(root);
+    reap_zombie();
+    context->zombie = coroutine;
+    reap_zombie();
+}
+
+// Release what init_scheduler and init_event_loop set up once the program is done with
+static void close_scheduler(struct Interpreter *main)
+{
+    close(context->epollFd);
+    close(context->completionFd);
+    pthread_mutex_destroy(&context->completedLock);
+    reap_zombie();
+    free(main->coroutine);
+    main->coroutine = NULL;
+}
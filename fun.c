@@ -0,0 +1,337 @@
+#define _GNU_SOURCE // pthread_getattr_np, see stack_exhausted
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fun.h"
+
+// The interpreter is compiled into this file like into main.c. Everything in it is static, only
+// the fun_ functions below are seen by the host.
+#include "interpreter.h"
+
+struct fun_context
+{
+    struct Context *program;
+    char *name; // Of the source, the source map refers to it
+    struct RunError error; // Of the last compile or call, report is NULL if it succeeded
+};
+
+static pthread_once_t funInit = PTHREAD_ONCE_INIT;
+
+// Arguments and result of fun_call
+struct HostCall
+{
+    char const *name;
+    fun_value const *args;
+    size_t count;
+    fun_value result;
+};
+
+// Make ctx the program of this thread for a compile or call and start counting its limits.
+// Returns the context to go back to.
+static struct Context *enterContext(fun_context *ctx)
+{
+    struct Context *wasContext = context;
+    context = ctx->program;
+    limits_start(&context->sandbox);
+
+    free(ctx->error.report);
+    ctx->error = (struct RunError) {error_none, 0, 0, NULL};
+    return wasContext;
+}
+
+// Go back to wasContext after a compile or call, keeping its error if it failed
+static fun_status leaveContext(fun_context *ctx, struct Context *wasContext, bool ok, struct RunError error)
+{
+    context = wasContext;
+
+    if (ok)
+    {
+        return FUN_OK;
+    }
+    ctx->error = error;
+
+    switch (error.kind)
+    {
+    case error_ops:
+        return FUN_OPS_LIMIT;
+    case error_heap:
+        return FUN_HEAP_LIMIT;
+    case error_depth:
+        return FUN_DEPTH_LIMIT;
+    case error_timeout:
+        return FUN_TIMEOUT;
+    default:
+        return FUN_ERROR;
+    }
+}
+
+// Fail a call the host got wrong, the error has no place in the source
+static noreturn void hostFail(char const *format, char const *name)
+{
+    struct RunError error = {error_runtime, 0, 0, NULL};
+    size_t size;
+    FILE *out = open_memstream(&error.report, &size);
+    fprintf(out, format, name);
+    fputc('\n', out);
+    fclose(out);
+    raise_error(error);
+}
+
+// Bind value as the parameter called name of func_interpreter
+static void bindValue(struct Interpreter *func_interpreter, char const *name, fun_value value)
+{
+    struct data_type bound = {integer, "\0", 0, false};
+
+    if (value.type == FUN_INT)
+    {
+        bound.isInt = value.i;
+        bound.numType = int64;
+    }
+    else if (value.type == FUN_FLOAT)
+    {
+        bound.isInt = number_from_double(value.f).value;
+        bound.numType = float64;
+    }
+    else
+    {
+        // Both array types have 8 byte elements
+        bound.curr_data_type = array;
+        bound.isArray = new_array(value.array.length, value.type == FUN_FLOAT_ARRAY ? float64 : int64);
+        memcpy(bound.isArray->data, value.array.data, value.array.length * sizeof(uint64_t));
+    }
+
+    insert_pair(new_slice1(name, strlen(name)), bound, func_interpreter);
+}
+
+// Body of fun_call, run from the global scope. True if the function returned a value.
+static bool runHostCall(struct Interpreter *_interpreter, void *arg)
+{
+    struct HostCall *call = arg;
+    struct Function *func = get_function(call->name);
+
+    if (func == NULL)
+    {
+        hostFail("no function %s", call->name);
+    }
+    if (call->count != func->numParams)
+    {
+        hostFail("wrong number of arguments for %s", call->name);
+    }
+
+    // A host function is simply called back
+    if (func->native != NULL)
+    {
+        for (size_t i = 0; i < call->count; i++)
+        {
+            if (call->args[i].type != FUN_INT && call->args[i].type != FUN_FLOAT)
+            {
+                hostFail("%s only takes numbers", call->name);
+            }
+        }
+        if (!func->native(func->nativeData, call->args, call->count, &call->result))
+        {
+            hostFail("native function %s failed", call->name);
+        }
+        return true;
+    }
+
+    struct Interpreter *func_interpreter = functionFrame(func);
+    func_interpreter->function = function_name(call->name);
+    for (size_t i = 0; i < call->count; i++)
+    {
+        bindValue(func_interpreter, func->params[i], call->args[i]);
+    }
+
+    countOps(func_interpreter, 1);
+
+    struct Array *returned;
+    uint64_t value = runFunctionBody(func_interpreter, func_interpreter->function, func, &returned);
+    if (returned != NULL)
+    {
+        heap_release(returned);
+        hostFail("%s returned an array, only numbers can be passed back", call->name);
+    }
+
+    if (resultKind == float64)
+    {
+        call->result = fun_float(number_as_double(number_of(value, float64)));
+    }
+    else
+    {
+        call->result = fun_int(value);
+    }
+    return true;
+}
+
+fun_context *fun_new(char const *name)
+{
+    pthread_once(&funInit, init_array_kernels);
+
+    fun_context *ctx = calloc(1, sizeof(fun_context));
+    ctx->name = strdup(name != NULL ? name : "<fun>");
+
+    struct Context *wasContext = context;
+    ctx->program = new_context(ctx->name);
+    context = wasContext;
+
+    return ctx;
+}
+
+void fun_free(fun_context *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    free_context(ctx->program);
+
+    free(ctx->error.report);
+    free(ctx->name);
+    free(ctx);
+}
+
+fun_status fun_compile(fun_context *ctx, char const *source)
+{
+    struct Context *wasContext = enterContext(ctx);
+    struct Interpreter *global = context->global;
+
+    // The statements run from a copy, what they define keeps copies of its own
+    size_t length = strlen(source);
+    char *program = strdup(source);
+    global->program = program;
+    global->current = program;
+    global->origin = context->source.length;
+    global->braces = programBraces(program, length, global->origin);
+    source_add(&context->source, program, length);
+
+    bool more;
+    struct RunError error;
+    bool ok = runChecked(global, &more, &error);
+
+    brace_table_release(global->braces);
+    global->braces = NULL;
+    global->program = "";
+    global->current = global->program;
+    free(program);
+
+    return leaveContext(ctx, wasContext, ok, error);
+}
+
+fun_status fun_call(fun_context *ctx, char const *name, fun_value const *args, size_t count, fun_value *result)
+{
+    struct Context *wasContext = enterContext(ctx);
+
+    struct HostCall call = {name, args, count, fun_int(0)};
+    bool returned;
+    struct RunError error;
+    bool ok = runGuarded(runHostCall, context->global, &call, &returned, &error);
+
+    if (ok && result != NULL)
+    {
+        *result = call.result;
+    }
+    return leaveContext(ctx, wasContext, ok, error);
+}
+
+// Define func as name in ctx, false if name can't be called from Fun
+static bool defineNative(fun_context *ctx, char const *name, struct Function *func)
+{
+    if (!is_identifier(new_slice1(name, strlen(name))))
+    {
+        free_function(func);
+        return false;
+    }
+
+    struct Context *wasContext = context;
+    context = ctx->program;
+    insert_function(strdup(name), func);
+    context = wasContext;
+
+    return true;
+}
+
+bool fun_define(fun_context *ctx, char const *name, size_t arity, fun_native function, void *data)
+{
+    if (function == NULL)
+    {
+        return false;
+    }
+    return defineNative(ctx, name, new_native(arity, function, data));
+}
+
+// How fun_call passes fun_values to an integer function, data is its definition
+static bool nativeInt(void *data, fun_value const *args, size_t count, fun_value *result)
+{
+    int64_t ints[count];
+    for (size_t i = 0; i < count; i++)
+    {
+        if (args[i].type == FUN_FLOAT && !(args[i].f > -9223372036854775809.0 && args[i].f < 9223372036854775808.0))
+        {
+            return false;
+        }
+        ints[i] = args[i].type == FUN_FLOAT ? (int64_t) args[i].f : args[i].i;
+    }
+    *result = fun_int(callDirect(data, ints));
+    return true;
+}
+
+// Definition of the integer function direct of arity arguments
+static bool defineInt(fun_context *ctx, char const *name, size_t arity, void (*direct)(void))
+{
+    if (direct == NULL)
+    {
+        return false;
+    }
+    struct Function *func = new_native(arity, nativeInt, NULL);
+    func->nativeData = func;
+    func->direct = direct;
+    return defineNative(ctx, name, func);
+}
+
+bool fun_define_int1(fun_context *ctx, char const *name, fun_native_int1 function)
+{
+    return defineInt(ctx, name, 1, (void (*)(void)) function);
+}
+
+bool fun_define_int2(fun_context *ctx, char const *name, fun_native_int2 function)
+{
+    return defineInt(ctx, name, 2, (void (*)(void)) function);
+}
+
+bool fun_define_int3(fun_context *ctx, char const *name, fun_native_int3 function)
+{
+    return defineInt(ctx, name, 3, (void (*)(void)) function);
+}
+
+bool fun_define_int4(fun_context *ctx, char const *name, fun_native_int4 function)
+{
+    return defineInt(ctx, name, 4, (void (*)(void)) function);
+}
+
+void fun_set_limits(fun_context *ctx, uint64_t max_ops, size_t max_depth, size_t max_heap, double timeout)
+{
+    struct Limits *limits = &ctx->program->sandbox.limits;
+    limits->maxOps = max_ops;
+    limits->maxDepth = max_depth;
+    limits->timeout = timeout > 0 ? timeout * 1e9 : 0;
+    ctx->program->heap.limit = max_heap != 0 ? max_heap : SIZE_MAX;
+}
+
+char const *fun_error(fun_context const *ctx, size_t *line, size_t *column)
+{
+    if (line != NULL)
+    {
+        *line = ctx->error.line;
+    }
+    if (column != NULL)
+    {
+        *column = ctx->error.column;
+    }
+    return ctx->error.report;
+}
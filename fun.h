@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Embedding API. A host compiles fun.c into itself or builds it as a shared library, which only
+// export these functions, and runs Fun programs through it without starting a process.
+//
+//     fun_context *ctx = fun_new("scoring.fun");
+//     if (fun_compile(ctx, source) != FUN_OK) {
+//         fputs(fun_error(ctx, NULL, NULL), stderr);
+//     }
+//     fun_value args[] = {fun_int(3), fun_float(0.25)};
+//     fun_value score;
+//     fun_call(ctx, "score", args, 2, &score);
+//
+// Each context holds one program: the functions it defined, its globals, its coroutines, its
+// limits and its heap. Contexts share nothing, so threads can run different contexts at the same
+// time. One context must only be used by one thread at a time.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Exported by a shared library even when it is built with -fvisibility=hidden
+#define FUN_API __attribute__((visibility("default")))
+
+typedef struct fun_context fun_context;
+
+// Outcome of a compile or call, the kinds of error a run can stop with
+typedef enum
+{
+    FUN_OK,
+    FUN_ERROR, // Runtime or syntax error, or a bad call from the host
+    FUN_OPS_LIMIT, // Ran more operations than fun_set_limits allows
+    FUN_HEAP_LIMIT, // Needed more live heap than fun_set_limits allows
+    FUN_DEPTH_LIMIT, // Nested calls deeper than fun_set_limits allows
+    FUN_TIMEOUT // Ran longer than fun_set_limits allows
+} fun_status;
+
+typedef enum
+{
+    FUN_INT, // int64_t, or a plain Fun integer's bits
+    FUN_FLOAT, // double
+    FUN_INT_ARRAY, // int64_t elements, only as an argument
+    FUN_FLOAT_ARRAY // double elements, only as an argument
+} fun_type;
+
+// A value passed between the host and Fun. Arrays are copied into the call, Fun can't change
+// the host's elements.
+typedef struct
+{
+    fun_type type;
+    union {
+        int64_t i;
+        double f;
+        struct {
+            void const *data;
+            size_t length;
+        } array;
+    };
+} fun_value;
+
+static inline fun_value fun_int(int64_t i)
+{
+    fun_value v;
+    v.type = FUN_INT;
+    v.i = i;
+    return v;
+}
+
+static inline fun_value fun_float(double f)
+{
+    fun_value v;
+    v.type = FUN_FLOAT;
+    v.f = f;
+    return v;
+}
+
+static inline fun_value fun_int_array(int64_t const *data, size_t length)
+{
+    fun_value v;
+    v.type = FUN_INT_ARRAY;
+    v.array.data = data;
+    v.array.length = length;
+    return v;
+}
+
+static inline fun_value fun_float_array(double const *data, size_t length)
+{
+    fun_value v;
+    v.type = FUN_FLOAT_ARRAY;
+    v.array.data = data;
+    v.array.length = length;
+    return v;
+}
+
+// Function of the host that Fun code calls like one of its own. It gets count numbers, FUN_INT
+// or FUN_FLOAT, and sets *result to one. Returning false fails the Fun program at the call.
+typedef bool (*fun_native)(void *data, fun_value const *args, size_t count, fun_value *result);
+
+// Host functions of integers, called from Fun without boxing their arguments into fun_values.
+// A float argument is truncated, one that doesn't fit int64_t fails the call.
+typedef int64_t (*fun_native_int1)(int64_t);
+typedef int64_t (*fun_native_int2)(int64_t, int64_t);
+typedef int64_t (*fun_native_int3)(int64_t, int64_t, int64_t);
+typedef int64_t (*fun_native_int4)(int64_t, int64_t, int64_t, int64_t);
+
+// New context for a program, name is what error locations call its source
+FUN_API fun_context *fun_new(char const *name);
+
+FUN_API void fun_free(fun_context *ctx);
+
+// Run the top-level statements of source, a NUL terminated program, in ctx. This defines its
+// functions and globals. Compiling more source adds to what is there, like further lines of
+// the same file. The host's copy of source may go away afterwards.
+FUN_API fun_status fun_compile(fun_context *ctx, char const *source);
+
+// Call the Fun function name with count arguments and store what it returns, a FUN_INT or a
+// FUN_FLOAT, in *result. A function that ends without return gives 0.
+FUN_API fun_status fun_call(fun_context *ctx, char const *name, fun_value const *args, size_t count, fun_value *result);
+
+// Make function callable from the Fun code of ctx as name, with arity arguments. It is passed
+// data on every call. A Fun definition of the same name replaces it, and the other way round.
+FUN_API bool fun_define(fun_context *ctx, char const *name, size_t arity, fun_native function, void *data);
+
+// Like fun_define, for a function of integers. Each call site of the Fun code finds the
+// function once and then calls it directly until a definition changes.
+FUN_API bool fun_define_int1(fun_context *ctx, char const *name, fun_native_int1 function);
+FUN_API bool fun_define_int2(fun_context *ctx, char const *name, fun_native_int2 function);
+FUN_API bool fun_define_int3(fun_context *ctx, char const *name, fun_native_int3 function);
+FUN_API bool fun_define_int4(fun_context *ctx, char const *name, fun_native_int4 function);
+
+// Limits of each later compile or call, 0 for no limit: loop iterations and calls, nested
+// calls, bytes of live heap and wall-clock seconds. See the limits of the command line. The heap
+// limit covers everything the context holds, including what earlier calls left behind.
+FUN_API void fun_set_limits(fun_context *ctx, uint64_t max_ops, size_t max_depth, size_t max_heap, double timeout);
+
+// Report of the last compile or call that failed, with the line and column where it did if
+// those aren't NULL. NULL if the last one succeeded.
+FUN_API char const *fun_error(fun_context const *ctx, size_t *line, size_t *column);
+
+#ifdef __cplusplus
+}
+#endif
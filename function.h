@@ -12,10 +12,13 @@
 #include <stdbool.h>
 
 #include "hashmap.h"
+#include "memo.h"
+#include "context.h"
+#include "fun.h"
 
 #define MAP_SIZE 2
 
-size_t FUNCTION_CURR_SIZE = 2;
+// The table of the running program is context->functions, context->functionsSize slots of it
 
 // Stores parameters and code associated w/ function
 struct Function
@@ -23,6 +26,12 @@ struct Function
     char *code;
     char **params;
     size_t numParams;
+    struct MemoCache *memo; // Results by arguments for a memo fun, NULL for a plain one
+    struct BraceTable *braces; // Blocks of code, shared with the calls running it
+    size_t origin; // Offset of code in the source, for error locations
+    fun_native native; // Host function that runs instead of code, NULL for one defined in Fun
+    void *nativeData; // Passed to native
+    void (*direct)(void); // Host function of numParams int64_t arguments returning int64_t, called without boxing them, NULL for others
 };
 
 // Stores name of function as key, Function struct as value
@@ -33,7 +42,7 @@ struct FunctionPair
 };
 
 // Return hashcode for function entries
-size_t func_hash(const char *name) {
+static size_t func_hash(const char *name) {
     size_t out = 5381;
     for (size_t i = 0; i < strlen(name); i++) {
         char const c = name[i];
@@ -42,41 +51,83 @@ size_t func_hash(const char *name) {
     return out;
 }
 
-struct FunctionPair** functions;
-
-struct FunctionPair** resize_map() {
-    FUNCTION_CURR_SIZE *= 2;
+static struct FunctionPair** resize_map() {
+    context->functionsSize *= 2;
 
     // Double size of map, allocate memory
-    struct FunctionPair **resizeFunctions = malloc(sizeof(struct FunctionPair) * FUNCTION_CURR_SIZE);
+    struct FunctionPair **resizeFunctions = malloc(sizeof(struct FunctionPair) * context->functionsSize);
 
     // Set all values to null
-    for (int i = 0; i < FUNCTION_CURR_SIZE; i++) {
+    for (int i = 0; i < context->functionsSize; i++) {
         resizeFunctions[i] = NULL;
     }
 
-    for (int i = 0; i < FUNCTION_CURR_SIZE / 2; i++) {
-        struct FunctionPair *entry = functions[i];
-        size_t index = func_hash(entry->key) % (FUNCTION_CURR_SIZE);
+    for (int i = 0; i < context->functionsSize / 2; i++) {
+        struct FunctionPair *entry = context->functions[i];
+        size_t index = func_hash(entry->key) % (context->functionsSize);
 
 	// Remap entries w/ new hashcode
-        for (int j = index; j < index + FUNCTION_CURR_SIZE; j++)
+        for (int j = index; j < index + context->functionsSize; j++)
         {
             // Find first value that is null, or w/ same key
-            if (resizeFunctions[j % FUNCTION_CURR_SIZE] == NULL)
+            if (resizeFunctions[j % context->functionsSize] == NULL)
             {
-                resizeFunctions[j % FUNCTION_CURR_SIZE] = entry;
+                resizeFunctions[j % context->functionsSize] = entry;
                 break;
             }
         }
     }
 
-    free(functions);
+    free(context->functions);
     return resizeFunctions;
 }
 
+// Release a function definition and everything it owns
+static void free_function(struct Function *func)
+{
+    for (size_t i = 0; i < func->numParams; i++) {
+        free(func->params[i]);
+    }
+    free(func->params);
+    free(func->code);
+    brace_table_release(func->braces);
+    free_memo(func->memo);
+    free(func);
+}
+
+// Definition of a host function taking numParams arguments, see fun_define
+__attribute__((unused))
+static struct Function *new_native(size_t numParams, fun_native native, void *data)
+{
+    struct Function *func = calloc(1, sizeof(struct Function));
+    func->params = calloc(numParams + 1, sizeof(char *));
+    func->numParams = numParams;
+    func->native = native;
+    func->nativeData = data;
+    return func;
+}
+
+// Check if 2 definitions have the same parameters and body
+static bool same_function(struct Function *a, struct Function *b)
+{
+    if (a->native != NULL || b->native != NULL) {
+        return a->native == b->native && a->nativeData == b->nativeData && a->direct == b->direct && a->numParams == b->numParams;
+    }
+    if (a->numParams != b->numParams || (a->memo == NULL) != (b->memo == NULL) || strcmp(a->code, b->code) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->numParams; i++) {
+        if (strcmp(a->params[i], b->params[i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // Check if 2 strings are equal
-bool checkEqualStringFunction(char const *a, char *b, size_t len) {
+static bool checkEqualStringFunction(char const *a, char *b, size_t len) {
     while (*b != 0 && *a != 0) {
         if (*a != *b) {
             return false;
@@ -88,49 +139,86 @@ bool checkEqualStringFunction(char const *a, char *b, size_t len) {
     return *b == 0 && *a == 0;
 }
 
-// Initialize all values in functions to null
-void init_function_table() {
-    functions = malloc(sizeof(struct FunctionPair) * MAP_SIZE);
+// Initialize all values in the function table to null
+static void init_function_table() {
+    context->functionsSize = MAP_SIZE;
+    context->functionGeneration = 0;
+    context->functions = malloc(sizeof(struct FunctionPair) * MAP_SIZE);
 
     for (int i = 0; i < MAP_SIZE; i++) {
-        functions[i] = NULL;
+        context->functions[i] = NULL;
     }
 }
 
-void insert_function(char *key, struct Function *value)
+// Release every definition of the program along with the table
+static void free_function_table() {
+    for (size_t i = 0; i < context->functionsSize; i++) {
+        if (context->functions[i] != NULL) {
+            free(context->functions[i]->key);
+            free_function(context->functions[i]->value);
+            free(context->functions[i]);
+        }
+    }
+    free(context->functions);
+    context->functions = NULL;
+}
+
+static void insert_function(char *key, struct Function *value)
 {
     // Get index to place pair w/ modulus
-    size_t index = func_hash(key) % FUNCTION_CURR_SIZE;
-
-    struct FunctionPair *item = malloc(sizeof(struct FunctionPair));
-    item->key = key;
-    item->value = value;
+    size_t index = func_hash(key) % context->functionsSize;
 
-    for (int i = index; i < index + FUNCTION_CURR_SIZE; i++)
+    for (int i = index; i < index + context->functionsSize; i++)
     {
-        // Find first value that is null, or w/ same key
-        if (functions[i % FUNCTION_CURR_SIZE] == NULL || checkEqualStringFunction(key, (functions[i % FUNCTION_CURR_SIZE]->key), strlen(key)))
+        struct FunctionPair *entry = context->functions[i % context->functionsSize];
+
+        // Find first value that is null
+        if (entry == NULL)
+        {
+            struct FunctionPair *item = malloc(sizeof(struct FunctionPair));
+            item->key = key;
+            item->value = value;
+
+            context->functions[i % context->functionsSize] = item;
+            return;
+        }
+
+        // Redefinition of an existing function only replaces its own entry
+        if (checkEqualStringFunction(key, entry->key, strlen(key)))
         {
-            functions[i % FUNCTION_CURR_SIZE] = item;
+            if (same_function(entry->value, value))
+            {
+                // Unchanged definition, keep the one already in use
+                free_function(value);
+            }
+            else
+            {
+                free_function(entry->value);
+                entry->value = value;
+                context->functionGeneration++;
+            }
+
+            free(key);
             return;
         }
     }
 
-    functions = resize_map();
+    context->functions = resize_map();
     insert_function(key, value);
 }
 
-struct Function *get_function(const char *key)
+// Entry of the function called key, NULL if there is none
+static struct FunctionPair *function_entry(const char *key)
 {
     // Get index to place pair w/ modulus
-    size_t index = func_hash(key) % FUNCTION_CURR_SIZE;
+    size_t index = func_hash(key) % context->functionsSize;
 
-    for (int i = index; i < index + FUNCTION_CURR_SIZE; i++)
+    for (int i = index; i < index + context->functionsSize; i++)
     {
         // Find first value that is not null at index and is equal to key
-        if (functions[i % FUNCTION_CURR_SIZE] != NULL && checkEqualStringFunction(key, functions[i % FUNCTION_CURR_SIZE]->key, strlen(key)))
+        if (context->functions[i % context->functionsSize] != NULL && checkEqualStringFunction(key, context->functions[i % context->functionsSize]->key, strlen(key)))
         {
-            return functions[i % FUNCTION_CURR_SIZE]->value;
+            return context->functions[i % context->functionsSize];
         }
     }
 
@@ -138,15 +226,28 @@ struct Function *get_function(const char *key)
     return NULL;
 }
 
-bool contains_function(const char *key)
+static struct Function *get_function(const char *key)
+{
+    struct FunctionPair *entry = function_entry(key);
+    return entry != NULL ? entry->value : NULL;
+}
+
+// The name as the table keeps it, which stays valid for the rest of the run. NULL if there is no such function.
+static char const *function_name(const char *key)
+{
+    struct FunctionPair *entry = function_entry(key);
+    return entry != NULL ? entry->key : NULL;
+}
+
+static bool contains_function(const char *key)
 {
     // Get index to place pair w/ modulus
-    size_t index = func_hash(key) % FUNCTION_CURR_SIZE;
+    size_t index = func_hash(key) % context->functionsSize;
 
-    for (int i = index; i < index + FUNCTION_CURR_SIZE; i++)
+    for (int i = index; i < index + context->functionsSize; i++)
     {
         // Find first value that is not null at index and is equal to key
-        if (functions[i % FUNCTION_CURR_SIZE] != NULL && checkEqualStringFunction(key, functions[i % FUNCTION_CURR_SIZE]->key, strlen(functions[i % FUNCTION_CURR_SIZE]->key)))
+        if (context->functions[i % context->functionsSize] != NULL && checkEqualStringFunction(key, context->functions[i % context->functionsSize]->key, strlen(context->functions[i % context->functionsSize]->key)))
         {
             return true;
         }
@@ -158,3 +259,16 @@ bool contains_function(const char *key)
 
 
 
+
+// Hit and miss counts of every memo fun, for --memo-stats
+__attribute__((unused))
+static void print_memo_stats()
+{
+    for (size_t i = 0; i < context->functionsSize; i++) {
+        struct MemoCache *memo = context->functions[i] != NULL ? context->functions[i]->value->memo : NULL;
+        if (memo != NULL) {
+            fprintf(stderr, "memo %s: %zu hits, %zu misses, %zu evictions, %zu results cached\n",
+                    context->functions[i]->key, memo->hits, memo->misses, memo->evictions, memo->size);
+        }
+    }
+}
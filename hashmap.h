@@ -12,6 +12,7 @@
 #include <stdbool.h>
 
 #include "pair.h"
+#include "brace.h"
 // #include "slice.h"
 
 #define MAP_SIZE 2
@@ -23,19 +24,145 @@ struct Interpreter
     struct Pair **variables; // Hashmap of variables within scope
     size_t HASHMAP_CURR_SIZE; // Current size of hashmap
     struct Interpreter *next;
+    struct Coroutine *coroutine; // Set on the root interpreter of a coroutine
+    struct Queue *queued; // Queue the coroutine sleeps or waits to run in, NULL if none
+    bool ownsProgram; // program is a copy that goes away with the interpreter
+    struct BraceTable *braces; // Where the blocks of program end, NULL to find them by scanning
+    size_t origin; // Offset of program in the source, for error locations
+    struct Interpreter *caller; // Interpreter this one was started from, NULL for the global scope and coroutines
+    char const *function; // Function this one runs, NULL if it only evaluates text of its caller
+    char const *callSite; // Where the caller called it
+    uint64_t serial; // When it was opened as a frame, 0 if it isn't open, see open_frame
+    struct Interpreter *owner; // Root interpreter of the coroutine that opened the frame
+    struct Interpreter *openPrev; // Frame opened before it on this thread
+    struct Interpreter *openNext;
 };
 
+// Function frames and values that C code of this thread holds right now, most recent first. A
+// run that fails unwinds past the code that would free them, so it frees what is still open
+// instead. Each has the root interpreter of the coroutine that opened it as its owner, a
+// coroutine that was switched away from keeps what it holds.
+static __thread struct Interpreter *openFrames = NULL;
+static __thread uint64_t openSerial = 0; // Serial of the last frame or value opened on this thread
+
+// Value held with hold_value
+struct Held
+{
+    void (*release)(void *object);
+    void *object; // Updated by the holder when the object moves
+    uint64_t serial;
+    struct Interpreter *owner;
+    struct Held *prev; // Held before it on this thread
+    struct Held *next;
+};
+
+static __thread struct Held *heldValues = NULL;
+
+// Scope of the statement the thread is running, NULL outside of one. Errors raised where there is
+// no interpreter at hand, such as the heap limit, are reported at its current position.
+static __thread struct Interpreter *runningScope = NULL;
+
+// Record frame as held by the running code of the coroutine at owner
+static void open_frame(struct Interpreter *frame, struct Interpreter *owner)
+{
+    frame->serial = ++openSerial;
+    frame->owner = owner;
+    frame->openPrev = openFrames;
+    frame->openNext = NULL;
+    if (openFrames != NULL) {
+        openFrames->openNext = frame;
+    }
+    openFrames = frame;
+}
+
+// The code that opened frame let go of it, freed it or handed it to a coroutine
+static void close_frame(struct Interpreter *frame)
+{
+    if (frame->serial == 0) {
+        return;
+    }
+    if (frame->openNext != NULL) {
+        frame->openNext->openPrev = frame->openPrev;
+    } else {
+        openFrames = frame->openPrev;
+    }
+    if (frame->openPrev != NULL) {
+        frame->openPrev->openNext = frame->openNext;
+    }
+    frame->serial = 0;
+}
+
+// Record that the running code of owner holds object, which release frees if a run fails
+static struct Held *hold_value(void (*release)(void *), void *object, struct Interpreter *owner)
+{
+    struct Held *held = malloc(sizeof(struct Held));
+    *held = (struct Held) {release, object, ++openSerial, owner, heldValues, NULL};
+    if (heldValues != NULL) {
+        heldValues->next = held;
+    }
+    heldValues = held;
+    return held;
+}
+
+// The holder is done with the value, it keeps the object
+static void let_go(struct Held *held)
+{
+    if (held->next != NULL) {
+        held->next->prev = held->prev;
+    } else {
+        heldValues = held->prev;
+    }
+    if (held->prev != NULL) {
+        held->prev->next = held->next;
+    }
+    free(held);
+}
+
+static void free_interpreter(struct Interpreter *_interpreter);
+
+// Free the frames and values owner opened after serial, those of anyone when owner is NULL
+static void release_open_since(uint64_t serial, struct Interpreter *owner)
+{
+    struct Held *held = heldValues;
+    while (held != NULL && held->serial > serial) {
+        struct Held *prev = held->prev;
+        if (owner == NULL || held->owner == owner) {
+            held->release(held->object);
+            let_go(held);
+        }
+        held = prev;
+    }
+
+    struct Interpreter *frame = openFrames;
+    while (frame != NULL && frame->serial > serial) {
+        struct Interpreter *prev = frame->openPrev;
+        if (owner == NULL || frame->owner == owner) {
+            free_interpreter(frame);
+        }
+        frame = prev;
+    }
+}
+
 // Helper method to free interpreter and all its contents from memory
-void free_interpreter(struct Interpreter *_interpreter) {
+static void free_interpreter(struct Interpreter *_interpreter) {
+    close_frame(_interpreter);
     for (int i = 0; i < _interpreter->HASHMAP_CURR_SIZE; i++) {
+        if (_interpreter->variables[i] != NULL) {
+            free((char *) _interpreter->variables[i]->key.start);
+            release_value(&_interpreter->variables[i]->value);
+        }
 	    free(_interpreter->variables[i]);
     }
+    if (_interpreter->ownsProgram) {
+        free((char *) _interpreter->program);
+    }
+    brace_table_release(_interpreter->braces);
     free(_interpreter->variables);
     free(_interpreter);
 }
 
 // Initialize all values in hash_table to null
-void init_table(struct Interpreter *_interpreter) {
+static void init_table(struct Interpreter *_interpreter) {
 
     _interpreter->HASHMAP_CURR_SIZE = MAP_SIZE;
     _interpreter->variables = malloc(sizeof(struct Pair) * MAP_SIZE);
@@ -46,31 +173,51 @@ void init_table(struct Interpreter *_interpreter) {
 }
 
 // Constructor method for Interpreter struct
-struct Interpreter *constructor1(char const *prog)
+static struct Interpreter *constructor1(char const *prog)
 {
     struct Interpreter *_interpreter = (struct Interpreter *) malloc(sizeof(struct Interpreter));
     _interpreter->program = prog;
     _interpreter->current = prog;
+    _interpreter->next = NULL;
+    _interpreter->coroutine = NULL;
+    _interpreter->queued = NULL;
+    _interpreter->ownsProgram = false;
+    _interpreter->braces = NULL;
+    _interpreter->origin = 0;
+    _interpreter->caller = NULL;
+    _interpreter->function = NULL;
+    _interpreter->callSite = NULL;
+    _interpreter->serial = 0;
 
     init_table(_interpreter); // Initialize hashmap
 
     return _interpreter;
 }
 
-struct Interpreter *constructor2(char const *prog, struct Interpreter *prev)
+// Interpreter in the storage at _interpreter that evaluates prog in the scope of prev, whose
+// variables it borrows
+static struct Interpreter *constructor2(struct Interpreter *_interpreter, char const *prog, struct Interpreter *prev)
 {
-    struct Interpreter *_interpreter = (struct Interpreter *) malloc(sizeof(struct Interpreter));
-
     _interpreter->program = prog;
     _interpreter->current = prog;
     _interpreter->HASHMAP_CURR_SIZE = prev->HASHMAP_CURR_SIZE;
     _interpreter->variables = prev->variables;
+    _interpreter->next = NULL;
+    _interpreter->coroutine = NULL;
+    _interpreter->queued = NULL;
+    _interpreter->ownsProgram = false;
+    _interpreter->braces = NULL;
+    _interpreter->origin = 0;
+    _interpreter->caller = NULL;
+    _interpreter->function = NULL;
+    _interpreter->callSite = NULL;
+    _interpreter->serial = 0;
 
     return _interpreter;
 }
 
 // Method used to resize hashmap if full
-struct Pair **resize_variable_map(struct Interpreter *_interpreter) {
+static struct Pair **resize_variable_map(struct Interpreter *_interpreter) {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE * 2;
     struct Pair **hash_table = _interpreter->variables;
 
@@ -103,7 +250,8 @@ struct Pair **resize_variable_map(struct Interpreter *_interpreter) {
     return resizePair;
 }
 
-uint64_t get_from_array(struct Slice key, struct Interpreter *_interpreter, size_t arrayIndex) {
+// Element arrayIndex of the array named key into *value, false if key isn't an array or has no such element
+static bool get_from_array(struct Slice key, struct Interpreter *_interpreter, uint64_t arrayIndex, uint64_t *value) {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
     
     // Get index to place pair w/ modulus
@@ -114,14 +262,20 @@ uint64_t get_from_array(struct Slice key, struct Interpreter *_interpreter, size
         // Find first value that is not null at index and is equal to key
         if (_interpreter->variables[i % HASHMAP_CURR_SIZE] != NULL && operator2(key, (_interpreter->variables[i % HASHMAP_CURR_SIZE]->key)))
         {
-            return _interpreter->variables[i % HASHMAP_CURR_SIZE]->value.isArray[arrayIndex]->isInt;
+            struct data_type const *stored = &_interpreter->variables[i % HASHMAP_CURR_SIZE]->value;
+            if (stored->curr_data_type != array || !array_has(stored->isArray, arrayIndex)) {
+                return false;
+            }
+            *value = array_get(stored->isArray, arrayIndex);
+            return true;
         }
     }
 
-    return 0;
+    return false;
 }
 
-void insert_into_array(struct Slice key, struct data_type value, struct Interpreter *_interpreter, size_t arrayIndex) {
+// False if key isn't an array, has no element arrayIndex or the value doesn't fit its element kind
+static bool insert_into_array(struct Slice key, struct data_type value, struct Interpreter *_interpreter, uint64_t arrayIndex) {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
     
     // Get index to place pair w/ modulus
@@ -132,13 +286,20 @@ void insert_into_array(struct Slice key, struct data_type value, struct Interpre
         // Find first value that is not null at index and is equal to key
         if (_interpreter->variables[i % HASHMAP_CURR_SIZE] != NULL && operator2(key, (_interpreter->variables[i % HASHMAP_CURR_SIZE]->key)))
         {
-            _interpreter->variables[i % HASHMAP_CURR_SIZE]->value.isArray[arrayIndex]->isInt = value.isInt;
-            return;
+            struct data_type const *stored = &_interpreter->variables[i % HASHMAP_CURR_SIZE]->value;
+            if (stored->curr_data_type != array || !array_has(stored->isArray, arrayIndex) ||
+                !number_fits(stored->isArray->kind, value.isInt)) {
+                return false;
+            }
+            array_make_unique(stored->isArray);
+            array_set(stored->isArray, arrayIndex, value.isInt);
+            return true;
         }
     }
+    return false;
 }
 
-void insert_pair(struct Slice key, struct data_type value, struct Interpreter *_interpreter)
+static void insert_pair(struct Slice key, struct data_type value, struct Interpreter *_interpreter)
 {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
 
@@ -147,12 +308,29 @@ void insert_pair(struct Slice key, struct data_type value, struct Interpreter *_
 
     for (int i = index; i < index + HASHMAP_CURR_SIZE; i++)
     {
-        // Find first value that is null, or w/ same key
-        if (_interpreter->variables[i % HASHMAP_CURR_SIZE] == NULL || operator2(key, (_interpreter->variables[i % HASHMAP_CURR_SIZE]->key)))
+        struct Pair *entry = _interpreter->variables[i % HASHMAP_CURR_SIZE];
+
+        // Overwrite the value of an existing variable in place, dropping the old one
+        if (entry != NULL && operator2(key, entry->key))
+        {
+            struct data_type old = entry->value;
+            entry->value = value;
+            release_value(&old);
+            return;
+        }
+
+        // Find first value that is null
+        if (entry == NULL)
         {
-            _interpreter->variables[i % HASHMAP_CURR_SIZE] = malloc(sizeof(struct Pair));
-            _interpreter->variables[i % HASHMAP_CURR_SIZE]->key = key;
-            _interpreter->variables[i % HASHMAP_CURR_SIZE]->value = value;
+            // The key is copied so variables outlive the text they were declared in
+            char *name = malloc(key.len);
+            memcpy(name, key.start, key.len);
+
+            entry = malloc(sizeof(struct Pair));
+            entry->key = new_slice1(name, key.len);
+            entry->value = value;
+            entry->shared = false;
+            _interpreter->variables[i % HASHMAP_CURR_SIZE] = entry;
 
             return;
         }
@@ -162,7 +340,7 @@ void insert_pair(struct Slice key, struct data_type value, struct Interpreter *_
     insert_pair(key, value, _interpreter);
 }
 
-struct data_type get_value(struct Slice key, struct Interpreter *_interpreter)
+static struct data_type get_value(struct Slice key, struct Interpreter *_interpreter)
 {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
     
@@ -182,7 +360,33 @@ struct data_type get_value(struct Slice key, struct Interpreter *_interpreter)
     return default_return;
 }
 
-bool contains(struct Slice key, struct Interpreter *_interpreter)
+// Return the entry stored for key, NULL if missing
+static struct Pair *get_pair(struct Slice key, struct Interpreter *_interpreter)
+{
+    size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
+
+    // Get index to place pair w/ modulus
+    size_t index = hash_function(key) % HASHMAP_CURR_SIZE;
+    for (int i = index; i < index + HASHMAP_CURR_SIZE; i++)
+    {
+        // Find first value that is not null at index and is equal to key
+        if (_interpreter->variables[i % HASHMAP_CURR_SIZE] != NULL && operator2(key, (_interpreter->variables[i % HASHMAP_CURR_SIZE]->key)))
+        {
+            return _interpreter->variables[i % HASHMAP_CURR_SIZE];
+        }
+    }
+
+    return NULL;
+}
+
+// Return a pointer to the stored value so it can be changed in place, NULL if missing
+static struct data_type *get_value_ref(struct Slice key, struct Interpreter *_interpreter)
+{
+    struct Pair *entry = get_pair(key, _interpreter);
+    return entry == NULL ? NULL : &entry->value;
+}
+
+static bool contains(struct Slice key, struct Interpreter *_interpreter)
 {
     size_t HASHMAP_CURR_SIZE = _interpreter->HASHMAP_CURR_SIZE;
     struct Pair **hash_table = _interpreter->variables;
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sandbox.h"
+
+// Reference counted heap for the values variables hold: strings, arrays, maps, mapped files,
+// channels and coroutines. None of them can point back at another value, so counting
+// alone reclaims everything and an object is freed the moment its last holder lets go.
+
+// Sits in front of every object handed out by heap_alloc
+struct HeapHeader
+{
+    _Atomic size_t refcount;
+    size_t size; // Bytes requested, for the statistics
+    struct Heap *heap; // Accounts for the object
+    void (*finalize)(void *object); // Releases what the object owns, may be NULL
+    void *block; // Start of the allocation, the header itself unless over-aligned
+    max_align_t payload[]; // The object, aligned for any type
+};
+
+struct HeapStats
+{
+    _Atomic size_t allocations;
+    _Atomic size_t frees;
+    _Atomic size_t liveBytes;
+    _Atomic size_t peakBytes;
+};
+
+// Heap of one program, which objects it allocates count against
+struct Heap
+{
+    struct HeapStats stats;
+    size_t limit; // Most bytes that may be live at once, set with --max-heap
+};
+
+// Heap of the program the thread is running, see context.h
+static struct Heap *program_heap();
+
+static struct HeapHeader *heap_header(void const *object)
+{
+    return (struct HeapHeader *) ((char *) object - offsetof(struct HeapHeader, payload));
+}
+
+// Raise error_heap for heap, at the statement that allocated if there is one, see interpreter.h
+static noreturn void heap_limit_failed(struct Heap *heap);
+
+// Account for size more live bytes on heap, raises error_heap if that passes its limit
+static void heap_grow(struct Heap *heap, size_t size)
+{
+    size_t live = atomic_fetch_add(&heap->stats.liveBytes, size) + size;
+    if (live > heap->limit) {
+        atomic_fetch_sub(&heap->stats.liveBytes, size);
+        heap_limit_failed(heap);
+    }
+
+    size_t peak = atomic_load(&heap->stats.peakBytes);
+    while (live > peak && !atomic_compare_exchange_weak(&heap->stats.peakBytes, &peak, live)) {
+    }
+}
+
+// Raise error_heap unless size more bytes fit on the heap of the program right now, for values
+// made of several objects that must not leave the first ones behind when a later one fails
+static void heap_reserve(size_t size)
+{
+    struct Heap *heap = program_heap();
+    heap_grow(heap, size);
+    atomic_fetch_sub(&heap->stats.liveBytes, size);
+}
+
+// New object of size bytes with one reference, zeroed if clear is set
+static void *heap_alloc(size_t size, bool clear, void (*finalize)(void *))
+{
+    struct Heap *heap = program_heap();
+    heap_grow(heap, size);
+    atomic_fetch_add(&heap->stats.allocations, 1);
+
+    struct HeapHeader *header = clear ? calloc(1, sizeof(struct HeapHeader) + size) : malloc(sizeof(struct HeapHeader) + size);
+    if (header == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    atomic_init(&header->refcount, 1);
+    header->heap = heap;
+    header->size = size;
+    header->finalize = finalize;
+    header->block = header;
+    return header->payload;
+}
+
+// New zeroed object aligned to align bytes, which must be a power of 2 no smaller than the header
+static void *heap_alloc_aligned(size_t size, size_t align, void (*finalize)(void *))
+{
+    struct Heap *heap = program_heap();
+    heap_grow(heap, size);
+    atomic_fetch_add(&heap->stats.allocations, 1);
+
+    // The header sits at the end of the padding in front of the object
+    size_t total = (align + size + align - 1) / align * align;
+    char *block = aligned_alloc(align, total);
+    if (block == NULL) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    memset(block, 0, total);
+
+    struct HeapHeader *header = heap_header(block + align);
+    atomic_init(&header->refcount, 1);
+    header->heap = heap;
+    header->size = size;
+    header->finalize = finalize;
+    header->block = block;
+    return header->payload;
+}
+
+// Resize an object from heap_alloc that only the caller holds, the contents up to the smaller size are kept
+static void *heap_resize(void *object, size_t size)
+{
+    struct HeapHeader *header = heap_header(object);
+    if (size > header->size) {
+        heap_grow(header->heap, size - header->size);
+    } else {
+        atomic_fetch_sub(&header->heap->stats.liveBytes, header->size - size);
+    }
+
+    header = realloc(header, sizeof(struct HeapHeader) + size);
+    if (header == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    header->size = size;
+    header->block = header;
+    return header->payload;
+}
+
+// References held right now, 1 means the caller is the only holder
+static size_t heap_refcount(void const *object)
+{
+    return atomic_load_explicit(&heap_header(object)->refcount, memory_order_acquire);
+}
+
+static void heap_retain(void *object)
+{
+    if (object != NULL) {
+        atomic_fetch_add_explicit(&heap_header(object)->refcount, 1, memory_order_relaxed);
+    }
+}
+
+// Drop a reference, freeing the object with the last one
+static void heap_release(void *object)
+{
+    if (object == NULL) {
+        return;
+    }
+
+    struct HeapHeader *header = heap_header(object);
+    if (atomic_fetch_sub_explicit(&header->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    if (header->finalize != NULL) {
+        header->finalize(object);
+    }
+    atomic_fetch_sub(&header->heap->stats.liveBytes, header->size);
+    atomic_fetch_add(&header->heap->stats.frees, 1);
+    free(header->block);
+}
+
+__attribute__((unused))
+static void print_heap_stats()
+{
+    struct HeapStats *stats = &program_heap()->stats;
+    fprintf(stderr, "heap: %zu allocations, %zu freed, %zu bytes live, %zu bytes peak\n",
+            atomic_load(&stats->allocations), atomic_load(&stats->frees),
+            atomic_load(&stats->liveBytes), atomic_load(&stats->peakBytes));
+}
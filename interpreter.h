@@ -0,0 +1,5335 @@
+#pragma once
+
+#include <stdnoreturn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+
+#include "slice.h"
+#include "hashmap.h"
+#include "function.h"
+#include "coroutine.h"
+#include "channel.h"
+#include "io.h"
+#include "source.h"
+#include "sandbox.h"
+
+#define MAP_SIZE 2 // Initial size for map
+
+// Optional int struct for null return
+struct optional_int
+{
+    bool present;
+    uint64_t value;
+};
+
+// Optional slice struct for null return
+struct optional_slice
+{
+    bool present;
+    struct Slice value;
+};
+
+static bool diagnostics = false; // Report optimizer decisions on stderr
+
+static __thread bool inParallelRegion = false; // Running the body of a parallel for on a worker thread
+
+static __thread struct Array *returnedArray = NULL; // Array a return statement hands to the caller of its function
+
+static __thread uint64_t returnValue = 0; // Value of the last return statement, see flow_return
+
+// How a statement finished. Anything but flow_next ends the statements of the enclosing block.
+typedef enum
+{
+    flow_next, // Go on with the next statement
+    flow_end, // The block ended and its closing brace was consumed, or nothing more could be parsed
+    flow_return, // A return statement ran, its value is in returnValue
+    flow_break, // A break ran, the innermost loop ends
+    flow_continue // A continue ran, the innermost loop goes on with its next iteration
+} flow;
+
+static __thread number_kind resultKind = uint64; // Kind of the number the last function or built-in returned
+
+// function headers that needed to be defined at the top of the program to use them before their location in the code
+
+static bool consumeBracket(const char *str, struct Interpreter *_interpreter);
+
+static flow statements(bool effects, struct Interpreter *_interpreter);
+
+static uint64_t expression(bool effects, struct Interpreter *_interpreter);
+
+static struct number typedExpression(bool effects, struct Interpreter *_interpreter);
+
+static flow statement(bool effects, struct Interpreter *_interpreter);
+
+static uint64_t runFunction(bool effects, struct Interpreter *_interpreter, const char *name);
+
+static uint64_t callFunction(bool effects, struct Interpreter *_interpreter, const char *name, struct Array **arrayResult);
+
+static struct Function *resolveCall(struct Interpreter *_interpreter, struct Slice id, char const **name);
+
+static uint64_t callResolved(bool effects, struct Interpreter *_interpreter, const char *name, struct Function *func, struct Array **arrayResult);
+
+static struct Coroutine *spawnFunction(bool effects, struct Interpreter *_interpreter);
+
+static void checkPrivateWrite(struct Slice id, struct Interpreter *_interpreter);
+
+static struct data_type *lookupVariable(struct Slice name, struct Interpreter *_interpreter);
+
+static struct BraceTable *programBraces(char const *program, size_t length, size_t origin);
+
+static void rankSites();
+
+static bool runBuiltin(bool effects, struct Interpreter *_interpreter, const char *name, uint64_t *result);
+
+static char *runStringBuiltin(bool effects, struct Interpreter *_interpreter, const char *name);
+
+static char *parseString(bool effects, struct Interpreter *_interpreter);
+
+static uint64_t readMapEntry(bool effects, struct Interpreter *_interpreter, struct Map *m);
+
+static struct MemoCache *memoFor(char const *name, struct Function const *func);
+
+static bool memoArguments(struct Function const *func, struct Interpreter *func_interpreter, uint64_t *args, uint64_t *floats);
+
+static char *clearUntilClosingParen(struct Interpreter *_interpreter, size_t count);
+
+static bool consumeFunction(const char *str, struct Interpreter *_interpreter);
+
+// Print the line of program text around at with a caret under at
+static void printSourceLine(FILE *out, struct Interpreter const *_interpreter, char const *at)
+{
+    char const *start = at;
+    while (start > _interpreter->program && start[-1] != '\n')
+    {
+        start--;
+    }
+
+    size_t length = strcspn(start, "\n");
+    if (length > 0 && start[length - 1] == '\r')
+    {
+        length--;
+    }
+    fprintf(out, "    %.*s\n    ", (int) length, start);
+
+    // Tabs stay tabs so the caret lines up
+    for (char const *p = start; p < at; p++)
+    {
+        fputc(*p == '\t' ? '\t' : ' ', out);
+    }
+    fprintf(out, "^\n");
+}
+
+// Stop the run, reporting where and why it failed and the calls that led there. The error
+// unwinds to the recovery point of the thread, without one the program ends.
+static noreturn void failWith(struct Interpreter *_interpreter, error_kind kind, char const *message)
+{
+    char const *current = _interpreter->current;
+
+    // Blank lines a failed statement skipped before it noticed belong to the next one
+    char const *last = current;
+    while (last > _interpreter->program && isspace(last[-1]))
+    {
+        last--;
+    }
+    if (memchr(last, '\n', current - last) != NULL)
+    {
+        current = last;
+    }
+
+    struct RunError error = {kind, 0, 0, NULL};
+    size_t size;
+    FILE *out = open_memstream(&error.report, &size);
+
+    source_locate(&context->source, _interpreter->origin + (current - _interpreter->program), &error.line, &error.column);
+    fprintf(out, "%s:%zu:%zu: %s\n", context->source.name, error.line, error.column, message != NULL ? message : error_kind_names[kind]);
+
+    // An argument is evaluated from a copy, the caller has the whole line
+    struct Interpreter const *shown = _interpreter;
+    while (shown->function == NULL && shown->caller != NULL)
+    {
+        current = shown->caller->program + (shown->origin + (current - shown->program) - shown->caller->origin);
+        shown = shown->caller;
+    }
+    printSourceLine(out, shown, current);
+
+    // Runs of the same recursive call are printed once with a count
+    char const *previous = NULL;
+    size_t previousSite = SIZE_MAX;
+    size_t repeats = 0;
+
+    for (struct Interpreter const *frame = _interpreter; frame != NULL; frame = frame->caller)
+    {
+        if (frame->function == NULL)
+        {
+            continue;
+        }
+
+        size_t site = SIZE_MAX; // Source offset of the call, unknown for a coroutine or a call from the host
+        if (frame->caller != NULL)
+        {
+            struct Interpreter const *caller = frame->caller;
+
+            // The call site is just past the opening paren, point at the name instead
+            char const *at = frame->callSite;
+            size_t length = strlen(frame->function);
+            if (at - caller->program > (ptrdiff_t) length && memcmp(at - 1 - length, frame->function, length) == 0)
+            {
+                at -= 1 + length;
+            }
+            site = caller->origin + (at - caller->program);
+        }
+
+        if (previous != NULL && strcmp(frame->function, previous) == 0 && site == previousSite)
+        {
+            repeats++;
+            continue;
+        }
+        if (repeats > 0)
+        {
+            fprintf(out, "  ... %zu more times\n", repeats);
+            repeats = 0;
+        }
+        previous = frame->function;
+        previousSite = site;
+
+        fprintf(out, "  in %s", frame->function);
+        if (site != SIZE_MAX)
+        {
+            fprintf(out, " called at ");
+            source_print_location(&context->source, out, site);
+        }
+        else if (frame->coroutine != NULL)
+        {
+            fprintf(out, ", spawned as a coroutine");
+        }
+        else
+        {
+            fprintf(out, " called by the host");
+        }
+        fprintf(out, "\n");
+    }
+    if (repeats > 0)
+    {
+        fprintf(out, "  ... %zu more times\n", repeats);
+    }
+
+    fclose(out);
+    raise_error(error);
+}
+
+static noreturn void fail(struct Interpreter *_interpreter)
+{
+    failWith(_interpreter, error_runtime, NULL);
+}
+
+static noreturn void heap_limit_failed(struct Heap *heap)
+{
+    char message[64];
+    snprintf(message, sizeof(message), "heap limit of %zu bytes exceeded", heap->limit);
+    if (runningScope != NULL)
+    {
+        failWith(runningScope, error_heap, message);
+    }
+
+    // Outside of any statement, e.g. while a host call copies its arguments in
+    struct RunError error = {error_heap, 0, 0, NULL};
+    size_t length = strlen(message);
+    error.report = malloc(length + 2);
+    memcpy(error.report, message, length);
+    strcpy(error.report + length, "\n");
+    raise_error(error);
+}
+
+// Fail at a[index] = ... or a[index] when a is an array without that element, or for any other
+// reason it can't be read or written
+static noreturn void elementFail(struct Interpreter *_interpreter, struct Slice id, uint64_t index)
+{
+    struct data_type const *stored = lookupVariable(id, _interpreter);
+    if (stored != NULL && stored->curr_data_type == array && !array_has(stored->isArray, index))
+    {
+        char message[96];
+        snprintf(message, sizeof(message), "index %lu out of bounds of array of length %zu", index, stored->isArray->length);
+        failWith(_interpreter, error_runtime, message);
+    }
+    fail(_interpreter);
+}
+
+// Fail after a system call, reporting why it failed
+static noreturn void ioFail(struct Interpreter *_interpreter, char const *what)
+{
+    char message[512];
+    snprintf(message, sizeof(message), "%s: %s", what, strerror(errno));
+    failWith(_interpreter, error_runtime, message);
+}
+
+// Count n operations against the limits of the run, at loop back-edges and calls
+static void countOps(struct Interpreter *_interpreter, uint64_t n)
+{
+    opsBudget -= n;
+    if (opsBudget < 0)
+    {
+        error_kind kind = refill_ops(&context->sandbox);
+        if (kind != error_none)
+        {
+            failWith(_interpreter, kind, NULL);
+        }
+    }
+}
+
+static void end_or_fail(struct Interpreter *_interpreter)
+{
+    char const *current = _interpreter->current;
+
+    while (isspace(*current))
+    {
+        current += 1;
+    }
+
+    if (*current != 0)
+    {
+        fail(_interpreter);
+    }
+}
+
+// Remove whitespace in String
+static void skip(struct Interpreter *_interpreter)
+{
+    char const *current = _interpreter->current;
+
+    while (isspace(*current))
+    {
+        current += 1;
+    }
+
+    // Update value of current
+    _interpreter->current = current;
+}
+
+// Parse the current line as a String
+static bool consume(const char *str, struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    char const *current = _interpreter->current;
+
+    size_t i = 0;
+    while (true)
+    {
+        char const expected = str[i];
+        char const found = current[i];
+
+        if (expected == 0)
+        {
+            /* survived to the end of the expected string */
+            current += i;
+            _interpreter->current = current;
+            return true;
+        }
+        if (expected != found)
+        {
+            return false;
+        }
+        // assertion: found != 0
+        i += 1;
+    }
+}
+
+// Consume str only as a whole word, so "break" doesn't match the start of "breaks = 0"
+static bool consumeKeyword(const char *str, struct Interpreter *_interpreter)
+{
+    char const *start = _interpreter->current;
+    if (consume(str, _interpreter) && !isalnum(*_interpreter->current) && *_interpreter->current != '_')
+    {
+        return true;
+    }
+    _interpreter->current = start;
+    return false;
+}
+
+// Return the name of the variable (identifier) as a struct
+static struct optional_slice consume_identifier(struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    char const *current = _interpreter->current;
+
+    struct optional_slice v;
+    v.present = false;
+
+    if (isalpha(*current)) // Check if current character is alphabetic
+    {
+        char const *start = current;
+        do
+        {
+            current += 1;
+        } while (isalnum(*current)); // Check if current character is alphanumeric
+
+        struct Slice _slice = new_slice1(start, (size_t)(current - start));
+        v.present = true;
+        v.value = _slice;
+        // Update value of current
+        _interpreter->current = current;
+    }
+    return v;
+}
+
+// Length of the float literal at p, digits with a fraction or an exponent like 1.5, 2e-3 or 1.5e3. 0 if there is none.
+static size_t floatLiteralLength(char const *p)
+{
+    char const *start = p;
+    if (!isdigit(*p))
+    {
+        return 0;
+    }
+    while (isdigit(*p))
+    {
+        p++;
+    }
+
+    bool isFloat = false;
+    if (*p == '.' && isdigit(p[1]))
+    {
+        isFloat = true;
+        p++;
+        while (isdigit(*p))
+        {
+            p++;
+        }
+    }
+    if (*p == 'e' || *p == 'E')
+    {
+        char const *digits = p + 1 + (p[1] == '+' || p[1] == '-');
+        if (isdigit(*digits))
+        {
+            isFloat = true;
+            p = digits;
+            while (isdigit(*p))
+            {
+                p++;
+            }
+        }
+    }
+    return isFloat ? (size_t) (p - start) : 0;
+}
+
+// Read a float literal into *value, false if there is none at the current position
+static bool consume_float_literal(struct Interpreter *_interpreter, double *value)
+{
+    skip(_interpreter);
+
+    size_t length = floatLiteralLength(_interpreter->current);
+    if (length == 0)
+    {
+        return false;
+    }
+    *value = strtod(_interpreter->current, NULL);
+    _interpreter->current += length;
+    return true;
+}
+
+// Return the integer value of a variable (literal) as a pointer. A float literal isn't one.
+static struct optional_int consume_literal(struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    struct optional_int ans;
+    ans.value = 0;
+    ans.present = false;
+
+    char const *current = _interpreter->current;
+
+    if (isdigit(*current) && floatLiteralLength(current) == 0)
+    {
+        uint64_t v = 0; // Value of literal
+        do
+        {
+            v = 10 * v + ((*current) - '0');
+            current += 1;
+        } while (isdigit(*current));
+
+        // Update value of current
+        _interpreter->current = current;
+        ans.present = true;
+        ans.value = v;
+    }
+    return ans;
+}
+
+static void printNumber(FILE *out, struct number v)
+{
+    char text[48];
+    number_format(text, sizeof(text), v);
+    fputs(text, out);
+}
+
+// Line print builds, it outlives the C stack if the print fails
+struct PrintLine
+{
+    char *text;
+    size_t length;
+    FILE *out;
+};
+
+static void close_print_line(void *object)
+{
+    struct PrintLine *line = object;
+    fclose(line->out);
+    free(line->text);
+    free(line);
+}
+
+static void printString(bool effects, struct Interpreter *_interpreter) {
+    // Build the line first so a call that suspends the coroutine can't split it
+    struct PrintLine *line = malloc(sizeof(struct PrintLine));
+    FILE *out = line->out = open_memstream(&line->text, &line->length);
+    struct Held *held = hold_value(close_print_line, line, context->running);
+
+    while (true) {
+        if (consume("\"", _interpreter)) {              
+            while (*_interpreter->current != '\"') {
+                fprintf(out, "%c", *_interpreter->current);
+                _interpreter->current++;
+            }
+            _interpreter->current++;
+        } else {
+            if (consume("(", _interpreter)) {
+                printNumber(out, typedExpression(effects, _interpreter));
+                if (!consume(")", _interpreter)) {
+                    fail(_interpreter);
+                }
+            } else {
+                struct optional_slice testid = consume_identifier(_interpreter);
+
+                if (!testid.present) {
+                    printNumber(out, typedExpression(effects, _interpreter));
+                    break;
+                }
+
+                if (consume("[", _interpreter)) {
+                    struct data_type *stored = lookupVariable(testid.value, _interpreter);
+
+                    if (stored != NULL && stored->curr_data_type == map) {
+                        fprintf(out, "%ld", readMapEntry(effects, _interpreter, stored->isMap));
+                    } else {
+                        uint64_t arrayIndex = expression(effects, _interpreter);
+                        consume("]", _interpreter);
+                        number_kind kind = stored != NULL && stored->curr_data_type == array ? stored->isArray->kind : uint64;
+
+                        uint64_t element;
+                        if (!get_from_array(testid.value, contains(testid.value, _interpreter) ? _interpreter : context->global, arrayIndex, &element)) {
+                            elementFail(_interpreter, testid.value, arrayIndex);
+                        }
+                        printNumber(out, number_of(element, kind));
+                    }
+                } else {
+                    struct Slice id = testid.value;
+                    char char_id[id.len + 1];
+                    memcpy(char_id, id.start, id.len);
+                    char_id[id.len] = '\0';
+
+                    uint64_t val;
+
+                    if (contains_function(char_id) && consume("(", _interpreter)) {
+                        resultKind = uint64;
+                        val = runFunction(effects, _interpreter, char_id);
+                        printNumber(out, number_of(val, resultKind));
+                        consume(")", _interpreter);
+                    } else if (consume("(", _interpreter)) {
+                        char *text = runStringBuiltin(effects, _interpreter, char_id);
+
+                        if (text != NULL) {
+                            fprintf(out, "%s", text);
+                            free(text);
+                        } else if (runBuiltin(effects, _interpreter, char_id, &val)) {
+                            printNumber(out, number_of(val, resultKind));
+                        } else {
+                            fail(_interpreter);
+                        }
+                    } else if (contains(testid.value, _interpreter)) {
+                        struct data_type returnVal = get_value(testid.value, _interpreter);
+
+                        if (returnVal.curr_data_type == integer) {
+                            printNumber(out, number_of(returnVal.isInt, returnVal.numType));
+                        } else if (returnVal.curr_data_type == boolean) {
+                            fprintf(out, "%d", returnVal.isBool ? 1 : 0);
+                        } else if (returnVal.curr_data_type == string) {
+                            fprintf(out, "%s", returnVal.ifString);
+                        } else if (returnVal.curr_data_type == view) {
+                            fwrite(returnVal.isView.text.start, 1, returnVal.isView.text.len, out);
+                        } else {
+                            fail(_interpreter);
+                        }
+                    } else {
+                        struct data_type returnVal = get_value(testid.value, context->global);
+
+                        if (returnVal.curr_data_type == integer) {
+                            printNumber(out, number_of(returnVal.isInt, returnVal.numType));
+                        } else if (returnVal.curr_data_type == boolean) {
+                            fprintf(out, "%d", returnVal.isBool ? 1 : 0);
+                        } else if (returnVal.curr_data_type == string) {
+                            fprintf(out, "%s", returnVal.ifString);
+                        } else if (returnVal.curr_data_type == view) {
+                            fwrite(returnVal.isView.text.start, 1, returnVal.isView.text.len, out);
+                        } else {
+                            fail(_interpreter);
+                        }
+                    }
+                }
+            }
+        }
+        if (!consume("+", _interpreter)) {
+            break;
+        }
+    }
+    fprintf(out, "\n");
+    fflush(out);
+    fwrite(line->text, 1, line->length, stdout);
+    let_go(held);
+    close_print_line(line);
+}
+
+// a op b for + - * / %. Once a float takes part the result is a float, signed values are
+// computed as int64_t and fail on overflow, plain integers wrap around like uint64_t.
+static struct number arithmetic(struct Interpreter *_interpreter, char op, struct number a, struct number b)
+{
+    if (a.isFloat || b.isFloat)
+    {
+        double x = number_as_double(a);
+        double y = number_as_double(b);
+        switch (op)
+        {
+            case '+':
+                return number_from_double(x + y);
+            case '-':
+                return number_from_double(x - y);
+            case '*':
+                return number_from_double(x * y);
+            case '/':
+                return number_from_double(x / y);
+            default:
+                return number_from_double(fmod(x, y));
+        }
+    }
+
+    if (a.isSigned || b.isSigned)
+    {
+        int64_t result;
+        if (!number_checked(op, a.value, b.value, &result))
+        {
+            fail(_interpreter);
+        }
+        return (struct number) {result, true};
+    }
+
+    switch (op)
+    {
+        case '+':
+            return (struct number) {a.value + b.value, false};
+        case '-':
+            return (struct number) {a.value - b.value, false};
+        case '*':
+            return (struct number) {a.value * b.value, false};
+        case '/':
+            return (struct number) {b.value == 0 ? 0 : a.value / b.value, false};
+        default:
+            return (struct number) {b.value == 0 ? 0 : a.value % b.value, false};
+    }
+}
+
+// a < b, compared as doubles if either is a float and as int64_t if either is signed
+static bool lessThan(struct number a, struct number b)
+{
+    if (a.isFloat || b.isFloat)
+    {
+        return number_as_double(a) < number_as_double(b);
+    }
+    return a.isSigned || b.isSigned ? (int64_t) a.value < (int64_t) b.value : a.value < b.value;
+}
+
+// a == b, a float equals an integer of the same value
+static bool equalTo(struct number a, struct number b)
+{
+    if (a.isFloat || b.isFloat)
+    {
+        return number_as_double(a) == number_as_double(b);
+    }
+    return a.value == b.value;
+}
+
+static struct number e1(bool effects, struct Interpreter *_interpreter)
+{
+    // Get the identifier of the variable
+    struct optional_slice testid = consume_identifier(_interpreter);
+
+    if (testid.present) // Check if slice is returned
+    {
+        struct Slice id = testid.value;
+
+        if (consume("[", _interpreter)) {
+            struct data_type *stored = lookupVariable(id, _interpreter);
+
+            if (stored != NULL && stored->curr_data_type == map) {
+                return (struct number) {readMapEntry(effects, _interpreter, stored->isMap), false};
+            }
+
+            uint64_t arrayIndex = expression(effects, _interpreter);
+            consume("]", _interpreter);
+            number_kind kind = stored != NULL && stored->curr_data_type == array ? stored->isArray->kind : uint64;
+
+            uint64_t element;
+            if (!get_from_array(id, contains(id, _interpreter) ? _interpreter : context->global, arrayIndex, &element)) {
+                elementFail(_interpreter, id, arrayIndex);
+            }
+            return number_of(element, kind);
+        }
+	
+	    // Check for function
+        if (consume("(", _interpreter))
+        {
+	    // If it is a print function, print the expression and return 0
+            if (operator1("print", id))
+            {
+                //printf("%lu\n", expression(effects, _interpreter));
+                printString(effects, _interpreter);
+                consume(")", _interpreter);
+                return (struct number) {0, false};
+            }
+
+	    // If it is a function stored in our map run the function and return its output
+            char const *name;
+            struct Function *func = resolveCall(_interpreter, id, &name);
+            if (func != NULL)
+            {
+                resultKind = uint64;
+                uint64_t val = callResolved(effects, _interpreter, name, func, NULL);
+		        return number_of(val, resultKind);
+            }
+
+	    // Otherwise it may be a built-in operation
+            char char_id[id.len + 1];
+            memcpy(char_id, id.start, id.len);
+            char_id[id.len] = '\0';
+            uint64_t val;
+            bool builtin = runBuiltin(effects, _interpreter, char_id, &val);
+            if (!builtin)
+            {
+                fail(_interpreter);
+            }
+            return number_of(val, resultKind);
+        }
+
+        if (operator1("true", testid.value)) {
+            return (struct number) {1, false};
+        } else if (operator1("false", testid.value)) {
+            return (struct number) {0, false};
+        }
+
+        // Get the value of the variable that is already stored in the map
+        if (contains(id, _interpreter))
+        {
+            struct data_type returnVal = get_value(id, _interpreter);
+
+            if (returnVal.curr_data_type == integer) {
+                return number_of(returnVal.isInt, returnVal.numType);
+            } else if (returnVal.curr_data_type == boolean) {
+                return (struct number) {returnVal.isBool ? 1 : 0, false};
+            } else {
+                fail(_interpreter);
+            }
+        }
+        else
+        {
+            struct data_type returnVal = get_value(id, context->global);
+
+            if (returnVal.curr_data_type == integer) {
+                return number_of(returnVal.isInt, returnVal.numType);
+            } else if (returnVal.curr_data_type == boolean) {
+                return (struct number) {returnVal.isBool ? 1 : 0, false};
+            } else {
+                fail(_interpreter);
+            }
+        }
+    }
+
+    double float_;
+    if (consume_float_literal(_interpreter, &float_))
+    {
+        return number_from_double(float_);
+    }
+
+    struct optional_int literal_ = consume_literal(_interpreter);
+
+    // Get the value of the variable that is not already stored in the map
+    if (literal_.present)
+    {
+        return (struct number) {literal_.value, false};
+    }
+    else if (consume("(", _interpreter)) // Check for parantheses
+    {
+        struct number v = typedExpression(effects, _interpreter);
+        consume(")", _interpreter);
+        return v;
+    }
+    else
+    {
+        fail(_interpreter);
+    }
+}
+
+// ++ -- unary+ unary- ... (Right)
+static struct number e2(bool effects, struct Interpreter *_interpreter)
+{
+    size_t count = 0;
+    skip(_interpreter);
+    char const *current = _interpreter->current;
+
+    // A negated value is signed, so -1 < 0 holds and negating INT64_MIN fails
+    if (*current == '-')
+    {
+        _interpreter->current = current + 1;
+        struct number v = e2(effects, _interpreter);
+        if (v.isFloat)
+        {
+            return number_from_double(-number_as_double(v));
+        }
+        return arithmetic(_interpreter, '-', (struct number) {0, true}, v);
+    }
+
+    if (*current == '!')
+    {
+        // Count number of exclamation marks
+        do
+        {
+            current += 1;
+            count++;
+        } while (*current == '!');
+
+        // Update value of current
+        _interpreter->current = current;
+    }
+
+    struct number v = e1(effects, _interpreter);
+
+    // Check for divisibility of number of exclamation marks
+
+    if (count > 0)
+    {
+        count %= 2;
+        bool truthy = number_truthy(v);
+        v.isSigned = false;
+        v.isFloat = false;
+        if (truthy)
+        {
+            if (count)
+            {
+                v.value = 0;
+            }
+            else
+            {
+                v.value = 1;
+            }
+        }
+        else
+        {
+            if (count)
+            {
+                v.value = 1;
+            }
+            else
+            {
+                v.value = 0;
+            }
+        }
+    }
+
+    return v;
+}
+
+// * / % (Left)
+static struct number e3(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v = e2(effects, _interpreter);
+
+    while (true)
+    {
+	// Check for multiplication
+        if (consume("*", _interpreter))
+        {
+            v = arithmetic(_interpreter, '*', v, e2(effects, _interpreter));
+        }
+
+	// Check for division
+        else if (consume("/", _interpreter))
+        {
+            v = arithmetic(_interpreter, '/', v, e2(effects, _interpreter));
+        }
+
+	// Check for modulus
+        else if (consume("%", _interpreter))
+        {
+            v = arithmetic(_interpreter, '%', v, e2(effects, _interpreter));
+        }
+        else
+        {
+            return v;
+        }
+    }
+}
+
+// (Left) + -
+static struct number e4(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v = e3(effects, _interpreter);
+
+    while (true)
+    {
+	// Check for addition
+        if (consume("+", _interpreter))
+        {
+            v = arithmetic(_interpreter, '+', v, e3(effects, _interpreter));
+        }
+	
+	// Check for subtraction
+        else if (consume("-", _interpreter))
+        {
+            v = arithmetic(_interpreter, '-', v, e3(effects, _interpreter));
+        }
+        else
+        {
+            return v;
+        }
+    }
+}
+
+// << >>
+static struct number e5(bool effects, struct Interpreter *_interpreter)
+{
+    return e4(effects, _interpreter);
+}
+
+// < <= > >=
+static struct number e6(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v1 = e5(effects, _interpreter);
+
+    while (true)
+    {
+	// Check if v1 < v2
+        if (consume("<", _interpreter))
+        {
+	    // Check if v1 <= v2
+            if (consume("=", _interpreter))
+            {
+                struct number v2 = e5(effects, _interpreter);
+
+                if (!lessThan(v2, v1))
+                {
+                    v1 = (struct number) {1, false};
+                }
+                else
+                {
+                    v1 = (struct number) {0, false};
+                }
+            }
+            else
+            {
+                struct number v2 = e5(effects, _interpreter);
+
+                if (lessThan(v1, v2))
+                {
+                    v1 = (struct number) {1, false};
+                }
+                else
+                {
+                    v1 = (struct number) {0, false};
+                }
+            }
+        }
+
+	// Check if v1 > v2
+        else if (consume(">", _interpreter))
+        {
+	    // Check if v1 >= v2
+            if (consume("=", _interpreter))
+            {
+                struct number v2 = e5(effects, _interpreter);
+
+                if (!lessThan(v1, v2))
+                {
+                    v1 = (struct number) {1, false};
+                }
+                else
+                {
+                    v1 = (struct number) {0, false};
+                }
+            }
+            else
+            {
+                struct number v2 = e5(effects, _interpreter);
+
+                if (lessThan(v2, v1))
+                {
+                    v1 = (struct number) {1, false};
+                }
+                else
+                {
+                    v1 = (struct number) {0, false};
+                }
+            }
+        }
+        else
+        {
+            return v1;
+        }
+    }
+}
+
+// == !=
+static struct number e7(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v1 = e6(effects, _interpreter);
+
+    while (true)
+    {
+	// Check if v1 == v2
+        if (consume("==", _interpreter))
+        {
+            struct number v2 = e6(effects, _interpreter);
+
+            if (equalTo(v1, v2))
+            {
+                v1 = (struct number) {1, false};
+            }
+            else
+            {
+                v1 = (struct number) {0, false};
+            }
+        }
+
+	// Check if v1 != v2
+        else if (consume("!=", _interpreter))
+        {
+            struct number v2 = e6(effects, _interpreter);
+
+            if (!equalTo(v1, v2))
+            {
+                v1 = (struct number) {1, false};
+            }
+            else
+            {
+                v1 = (struct number) {0, false};
+            }
+        }
+        else
+        {
+            return v1;
+        }
+    }
+}
+
+// (left) &
+static struct number e8(bool effects, struct Interpreter *_interpreter)
+{
+    return e7(effects, _interpreter);
+}
+
+// ^
+static struct number e9(bool effects, struct Interpreter *_interpreter)
+{
+    return e8(effects, _interpreter);
+}
+
+// |
+static struct number e10(bool effects, struct Interpreter *_interpreter)
+{
+    return e9(effects, _interpreter);
+}
+
+// &&
+static struct number e11(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v1 = e10(effects, _interpreter);
+
+    while (true)
+    {
+	// Check if v1 && v2
+        if (consume("&&", _interpreter))
+        {
+            struct number v2 = e10(effects, _interpreter);
+
+            if (number_truthy(v1) && number_truthy(v2))
+            {
+                v1 = (struct number) {1, false};
+            }
+            else
+            {
+                v1 = (struct number) {0, false};
+            }
+        }
+        else
+        {
+            return v1;
+        }
+    }
+}
+
+// ||
+static struct number e12(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v1 = e11(effects, _interpreter);
+
+    while (true)
+    {
+	// Check if v1 || v2
+        if (consume("||", _interpreter))
+        {
+            struct number v2 = e11(effects, _interpreter);
+
+            if (number_truthy(v1) || number_truthy(v2))
+            {
+                v1 = (struct number) {1, false};
+            }
+            else
+            {
+                v1 = (struct number) {0, false};
+            }
+        }
+        else
+        {
+            return v1;
+        }
+    }
+}
+
+// (right with special treatment for middle expression) ?:
+static struct number e13(bool effects, struct Interpreter *_interpreter)
+{
+    return e12(effects, _interpreter);
+}
+
+// = += -= ...
+static struct number e14(bool effects, struct Interpreter *_interpreter)
+{
+    return e13(effects, _interpreter);
+}
+
+// Times a statement or expression has to run before its shape is worked out. Working out a
+// shape costs about as much as parsing the text once more, so anything that runs again pays for
+// it, and only text that runs once is simply parsed.
+#define FUSE_AFTER 2
+
+// With --profile-guided nothing is worked out until the sites ran this many times between them.
+// From then on the sites are ranked by their runs again whenever they ran as many times more,
+// or 16 times as many as there are sites if that is more, so ranking costs little per run.
+#define FUSE_WARMUP 4096
+
+// Share of all runs, in percent, that the sites --profile-guided picks ran
+#define FUSE_SHARE 90
+
+// Site of the statement or expression at the current position in the brace table, NULL if there
+// is none. Each run is counted, parallel workers share the table and only read it.
+static struct FastSite *fastSite(struct Interpreter *_interpreter)
+{
+    struct BraceTable *table = _interpreter->braces;
+    size_t offset = _interpreter->current - _interpreter->program;
+    if (table == NULL || offset >= table->length)
+    {
+        return NULL;
+    }
+
+    if (inParallelRegion)
+    {
+        return brace_fast_site(table, offset, false);
+    }
+    struct FastSite *site = brace_fast_site(table, offset, true);
+    if (site != NULL)
+    {
+        site->runs++;
+    }
+    if (context->guided && ++context->siteRuns == context->nextRanking)
+    {
+        rankSites();
+    }
+    return site;
+}
+
+// Whether site should have its shape worked out now: it hasn't been yet, and it ran FUSE_AFTER
+// times or, with --profile-guided, it is one of the sites that run most
+static bool fuseNow(struct FastSite const *site)
+{
+    if (site->kind != site_pending || inParallelRegion)
+    {
+        return false;
+    }
+    return context->guided ? site->hot : site->runs >= FUSE_AFTER;
+}
+
+// Read the operand of a simple expression at *p, after any blanks: an integer literal, true,
+// false, a variable, or an element of an array indexed by one of those. False if there is none.
+static bool parseSimpleOperand(char const *program, char const **p, struct ExprOperand *operand, bool allowElement)
+{
+    char const *current = *p;
+    while (isspace(*current))
+    {
+        current++;
+    }
+
+    if (isdigit(*current))
+    {
+        if (floatLiteralLength(current) != 0)
+        {
+            return false;
+        }
+        uint64_t v = 0;
+        do
+        {
+            v = 10 * v + (*current - '0');
+            current++;
+        } while (isdigit(*current));
+
+        *operand = (struct ExprOperand) {expr_literal, 0, 0, 0, 0, v};
+        *p = current;
+        return true;
+    }
+
+    if (!isalpha(*current))
+    {
+        return false;
+    }
+    char const *name = current;
+    do
+    {
+        current++;
+    } while (isalnum(*current));
+    struct Slice id = new_slice1(name, current - name);
+
+    char const *next = current;
+    while (isspace(*next))
+    {
+        next++;
+    }
+    if (*next == '(')
+    {
+        return false;
+    }
+
+    if (*next == '[')
+    {
+        struct ExprOperand index;
+        next++;
+        if (!allowElement || !parseSimpleOperand(program, &next, &index, false))
+        {
+            return false;
+        }
+        while (isspace(*next))
+        {
+            next++;
+        }
+        if (*next != ']')
+        {
+            return false;
+        }
+        *operand = (struct ExprOperand) {expr_element, name - program, id.len, index.name, index.nameLength, index.value};
+        *p = next + 1;
+        return true;
+    }
+
+    if (operator1("true", id) || operator1("false", id))
+    {
+        *operand = (struct ExprOperand) {expr_literal, 0, 0, 0, 0, operator1("true", id)};
+    }
+    else
+    {
+        *operand = (struct ExprOperand) {expr_variable, name - program, id.len, 0, 0, 0};
+    }
+    *p = current;
+    return true;
+}
+
+// Work out whether the expression at offset of program is simple, one operand or two with one
+// of the operators of e4, e6 and e7 between them, and fill in *site if it is. Whatever follows
+// must end the expression for the generic parser too.
+static bool parseSimpleExpression(char const *program, size_t offset, struct SimpleExpression *site)
+{
+    char const *p = program + offset;
+    if (!parseSimpleOperand(program, &p, &site->left, true))
+    {
+        return false;
+    }
+    while (isspace(*p))
+    {
+        p++;
+    }
+
+    site->op = 0;
+    if (strchr("+-*/%", *p) != NULL && *p != 0)
+    {
+        site->op = *p++;
+    }
+    else if (*p == '<' || *p == '>')
+    {
+        char const *q = p + 1;
+        while (isspace(*q))
+        {
+            q++;
+        }
+        site->op = *q == '=' ? (*p == '<' ? 'l' : 'g') : *p;
+        p = *q == '=' ? q + 1 : p + 1;
+    }
+    else if ((p[0] == '=' || p[0] == '!') && p[1] == '=')
+    {
+        site->op = p[0];
+        p += 2;
+    }
+
+    if (site->op != 0)
+    {
+        // An element index doesn't nest, so a[b[i]] is parsed as usual
+        if (!parseSimpleOperand(program, &p, &site->right, true))
+        {
+            return false;
+        }
+        while (isspace(*p))
+        {
+            p++;
+        }
+    }
+
+    // Another operator means a longer expression
+    if (*p != 0 && strchr("+-*/%<>=!&|", *p) != NULL)
+    {
+        return false;
+    }
+    site->end = p - program;
+    return true;
+}
+
+// Value of an operand of a simple expression, false if it isn't a number that e1 would read
+static bool simpleOperand(struct Interpreter *_interpreter, struct ExprOperand const *operand, struct number *v)
+{
+    if (operand->kind == expr_literal)
+    {
+        *v = (struct number) {operand->value, false};
+        return true;
+    }
+
+    struct data_type *stored = lookupVariable(new_slice1(_interpreter->program + operand->name, operand->nameLength), _interpreter);
+    if (stored == NULL)
+    {
+        return false;
+    }
+
+    if (operand->kind == expr_variable)
+    {
+        if (stored->curr_data_type == integer)
+        {
+            *v = number_of(stored->isInt, stored->numType);
+            return true;
+        }
+        if (stored->curr_data_type == boolean)
+        {
+            *v = (struct number) {stored->isBool ? 1 : 0, false};
+            return true;
+        }
+        return false;
+    }
+
+    if (stored->curr_data_type != array)
+    {
+        return false;
+    }
+    uint64_t index = operand->value;
+    if (operand->indexLength != 0)
+    {
+        struct data_type *indexStored = lookupVariable(new_slice1(_interpreter->program + operand->index, operand->indexLength), _interpreter);
+        if (indexStored != NULL && indexStored->curr_data_type == integer)
+        {
+            index = indexStored->isInt;
+        }
+        else if (indexStored != NULL && indexStored->curr_data_type == boolean)
+        {
+            index = indexStored->isBool ? 1 : 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (!array_has(stored->isArray, index))
+    {
+        return false;
+    }
+    *v = number_of(array_get(stored->isArray, index), stored->isArray->kind);
+    return true;
+}
+
+// a op b for the operators of a simple expression. Plain integers, which most loops count
+// with, are added, subtracted and compared right here without the checks of the other kinds.
+static struct number simpleOperator(struct Interpreter *_interpreter, char op, struct number a, struct number b)
+{
+    bool plain = !a.isSigned && !a.isFloat && !b.isSigned && !b.isFloat;
+
+    switch (op)
+    {
+    case '+':
+        return plain ? (struct number) {a.value + b.value, false} : arithmetic(_interpreter, op, a, b);
+    case '-':
+        return plain ? (struct number) {a.value - b.value, false} : arithmetic(_interpreter, op, a, b);
+    case '<':
+        return (struct number) {plain ? a.value < b.value : lessThan(a, b), false};
+    case '>':
+        return (struct number) {plain ? a.value > b.value : lessThan(b, a), false};
+    case 'l':
+        return (struct number) {plain ? a.value <= b.value : !lessThan(b, a), false};
+    case 'g':
+        return (struct number) {plain ? a.value >= b.value : !lessThan(a, b), false};
+    case '=':
+        return (struct number) {equalTo(a, b), false};
+    case '!':
+        return (struct number) {!equalTo(a, b), false};
+    default:
+        return arithmetic(_interpreter, op, a, b);
+    }
+}
+
+// Evaluate the expression at the current position without parsing it, if it is simple and its
+// operands are numbers. Once it ran FUSE_AFTER times its shape is kept in the brace table, where
+// later runs find it. False leaves it to the generic parser.
+static bool simpleExpression(struct Interpreter *_interpreter, struct number *result)
+{
+    if (_interpreter->braces == NULL)
+    {
+        return false;
+    }
+    skip(_interpreter);
+    if (!isalnum(*_interpreter->current))
+    {
+        return false;
+    }
+
+    char const *program = _interpreter->program;
+    struct FastSite *site = fastSite(_interpreter);
+    if (site != NULL && fuseNow(site))
+    {
+        site->kind = parseSimpleExpression(program, site->offset, &site->expression) ? site_expression : site_generic;
+    }
+    if (site == NULL || site->kind != site_expression)
+    {
+        return false;
+    }
+
+    struct SimpleExpression const *simple = &site->expression;
+    struct number left;
+    struct number right;
+    if (!simpleOperand(_interpreter, &simple->left, &left) || (simple->op != 0 && !simpleOperand(_interpreter, &simple->right, &right)))
+    {
+        return false;
+    }
+
+    _interpreter->current = program + simple->end;
+    *result = simple->op == 0 ? left : simpleOperator(_interpreter, simple->op, left, right);
+    return true;
+}
+
+// ,
+static struct number e15(bool effects, struct Interpreter *_interpreter)
+{
+    struct number v;
+    if (simpleExpression(_interpreter, &v))
+    {
+        return v;
+    }
+    return e14(effects, _interpreter);
+}
+
+// Parse the arithmetic expression recursively
+static uint64_t expression(bool effects, struct Interpreter *_interpreter)
+{
+    return e15(effects, _interpreter).value;
+}
+
+// Parse an expression and keep track of whether its value is signed or a float
+static struct number typedExpression(bool effects, struct Interpreter *_interpreter)
+{
+    return e15(effects, _interpreter);
+}
+
+// Whether a simple expression holds, as a condition. A comparison of plain integers goes straight
+// to the answer, without making a number of it first. False if an operand isn't a number.
+static bool simpleCondition(struct Interpreter *_interpreter, struct SimpleExpression const *simple, bool *holds)
+{
+    struct number left;
+    struct number right = {0, false};
+    if (!simpleOperand(_interpreter, &simple->left, &left) || (simple->op != 0 && !simpleOperand(_interpreter, &simple->right, &right)))
+    {
+        return false;
+    }
+
+    if (!left.isSigned && !left.isFloat && !right.isSigned && !right.isFloat)
+    {
+        switch (simple->op)
+        {
+        case 0:
+            *holds = left.value != 0;
+            return true;
+        case '<':
+            *holds = left.value < right.value;
+            return true;
+        case '>':
+            *holds = left.value > right.value;
+            return true;
+        case 'l':
+            *holds = left.value <= right.value;
+            return true;
+        case 'g':
+            *holds = left.value >= right.value;
+            return true;
+        case '=':
+            *holds = left.value == right.value;
+            return true;
+        case '!':
+            *holds = left.value != right.value;
+            return true;
+        }
+    }
+    *holds = (simple->op == 0 ? left : simpleOperator(_interpreter, simple->op, left, right)).value != 0;
+    return true;
+}
+
+// Work out whether the condition at offset of program is simple and followed by ) {, as in an if
+// or a while, and fill in *branch if it is
+static bool parseBranch(char const *program, size_t offset, struct Branch *branch)
+{
+    if (!parseSimpleExpression(program, offset, &branch->condition))
+    {
+        return false;
+    }
+
+    char const *p = program + branch->condition.end;
+    if (*p != ')')
+    {
+        return false;
+    }
+    do
+    {
+        p++;
+    } while (isspace(*p));
+    if (*p != '{')
+    {
+        return false;
+    }
+    branch->body = p + 1 - program;
+    return true;
+}
+
+// Evaluate the condition at the current position and move past it, or with inBlock past the ) {
+// that follow it too. A simple condition is compared without parsing it once its site was worked
+// out, and one that is followed by ) { jumps straight into the block.
+static bool conditionHolds(bool effects, struct Interpreter *_interpreter, bool inBlock)
+{
+    skip(_interpreter);
+    char const *program = _interpreter->program;
+    struct FastSite *site = effects && isalnum(*_interpreter->current) ? fastSite(_interpreter) : NULL;
+    if (site != NULL && fuseNow(site))
+    {
+        if (inBlock && parseBranch(program, site->offset, &site->branch))
+        {
+            site->kind = site_branch;
+        }
+        else
+        {
+            site->kind = parseSimpleExpression(program, site->offset, &site->expression) ? site_expression : site_generic;
+        }
+    }
+
+    bool holds;
+    if (site != NULL && site->kind == site_branch && simpleCondition(_interpreter, &site->branch.condition, &holds))
+    {
+        _interpreter->current = program + site->branch.body;
+        return holds;
+    }
+    if (site != NULL && site->kind == site_expression && simpleCondition(_interpreter, &site->expression, &holds))
+    {
+        _interpreter->current = program + site->expression.end;
+    }
+    else
+    {
+        // The site was counted already, the generic parser mustn't count it again
+        holds = (site != NULL ? e14(effects, _interpreter) : e15(effects, _interpreter)).value != 0;
+    }
+
+    if (inBlock)
+    {
+        consume(")", _interpreter);
+        consume("{", _interpreter);
+    }
+    return holds;
+}
+
+// Parse an expression for a place that only holds integers, a float is truncated toward zero
+static uint64_t integerExpression(bool effects, struct Interpreter *_interpreter)
+{
+    uint64_t value;
+    if (!number_convert(typedExpression(effects, _interpreter), uint64, &value))
+    {
+        fail(_interpreter);
+    }
+    return value;
+}
+
+// New scope to run the body of func in, without its parameters yet
+static struct Interpreter *functionFrame(struct Function *func)
+{
+    // The body runs from a copy so redefining the function while it runs is safe
+    char *codeCopy = malloc(strlen(func->code) + 1);
+    strcpy(codeCopy, func->code);
+
+    struct Interpreter *func_interpreter = constructor1(codeCopy);
+    func_interpreter->ownsProgram = true;
+    func_interpreter->braces = brace_table_retain(func->braces);
+    func_interpreter->origin = func->origin;
+    open_frame(func_interpreter, context->running);
+
+    return func_interpreter;
+}
+
+// Evaluate the arguments of a call to func in the caller's scope and bind them in a new scope for its body
+static struct Interpreter *bindArguments(struct Interpreter *_interpreter, struct Function *func)
+{
+    // Get all parameters of function. The text lives on the stack, so a failing argument can't leak it.
+    char *parameterText = clearUntilClosingParen(_interpreter, 1);
+    char allParameters[strlen(parameterText) + 1];
+    strcpy(allParameters, parameterText);
+    free(parameterText);
+    size_t argumentsOrigin = _interpreter->origin + (_interpreter->current - _interpreter->program) - strlen(allParameters);
+    consume(")", _interpreter);
+
+    struct Interpreter *func_interpreter = functionFrame(func);
+
+    size_t i = 0; // Current position in string
+    size_t paramNum = 0; // Number of parameters
+
+    while (allParameters[i])
+    {
+        size_t parens = 0; // Number of parentheses
+        size_t start = i; // Where the current parameter begins
+
+	    // Delimit each parameter by commas
+        while (allParameters[i] && (allParameters[i] != ',' || parens > 0))
+        {
+            char found = allParameters[i];
+
+            if (found == '(')
+            {
+                parens++;
+            }
+            else if (found == ')')
+            {
+                parens--;
+            }
+
+            if (parens < 0)
+            {
+                fail(_interpreter);
+            }
+
+            i++;
+        }
+        char currString[i - start + 1]; // Current parameter
+        memcpy(currString, allParameters + start, i - start);
+        currString[i - start] = '\0';
+
+	    // Check for comma
+        if (allParameters[i] == ',')
+        {
+            i++;
+        }
+
+	    // Check for whitespace
+        while (allParameters[i] && allParameters[i] == '\040')
+        {
+            i++;
+        }
+
+        struct Interpreter param;
+        struct Interpreter *param_interpreter = constructor2(&param, currString, _interpreter);
+        param_interpreter->origin = argumentsOrigin + start;
+        param_interpreter->caller = _interpreter;
+        
+        struct data_type valueToInsert = {integer, "\0", 0, false};
+        struct Slice argument = new_slice1(currString, strlen(currString));
+
+        while (argument.len > 0 && isspace(argument.start[argument.len - 1]))
+        {
+            argument.len--;
+        }
+        struct data_type *source = is_identifier(argument) ? lookupVariable(argument, _interpreter) : NULL;
+
+        // An array argument shares the caller's elements until one side writes them
+        if (source != NULL && source->curr_data_type == array)
+        {
+            valueToInsert.curr_data_type = array;
+            valueToInsert.isArray = array_share(source->isArray);
+        }
+        // A map argument is passed by reference, changes made by the function are seen by the caller
+        else if (source != NULL && source->curr_data_type == map)
+        {
+            valueToInsert.curr_data_type = map;
+            valueToInsert.isMap = source->isMap;
+            heap_retain(valueToInsert.isMap);
+        }
+        else
+        {
+	    // Get value of current parameter, a float stays one
+            struct number parameter = typedExpression(true, param_interpreter);
+	        valueToInsert.isInt = parameter.value;
+            valueToInsert.numType = parameter.isFloat ? float64 : uint64;
+        }
+
+
+        char *param_name = func->params[paramNum];
+
+	    // Add parameter to hashmap of parameters for function
+        struct Slice key = new_slice1(param_name, strlen(param_name));
+        insert_pair(key, valueToInsert, func_interpreter);
+
+        paramNum++;
+    }
+
+	// Sanity check if number of parameters is expected
+    if (paramNum != func->numParams)
+    {
+        fail(_interpreter);
+    }
+
+    return func_interpreter;
+}
+
+// Run the body of a function, true if a return ended it. A break or continue has no loop to leave.
+static bool functionBody(struct Interpreter *_interpreter)
+{
+    flow result = statements(true, _interpreter);
+    if (result == flow_break || result == flow_continue)
+    {
+        fail(_interpreter);
+    }
+    return result == flow_return;
+}
+
+// Call func->direct, an integer host function, with its numParams arguments
+static int64_t callDirect(struct Function const *func, int64_t const *args)
+{
+    switch (func->numParams)
+    {
+    case 1:
+        return ((fun_native_int1) func->direct)(args[0]);
+    case 2:
+        return ((fun_native_int2) func->direct)(args[0], args[1]);
+    case 3:
+        return ((fun_native_int3) func->direct)(args[0], args[1], args[2]);
+    default:
+        return ((fun_native_int4) func->direct)(args[0], args[1], args[2], args[3]);
+    }
+}
+
+// Evaluate the arguments of a call to the host function func, defined as name, and run it
+static uint64_t callNative(bool effects, struct Interpreter *_interpreter, const char *name, struct Function *func)
+{
+    countOps(_interpreter, 1);
+
+    struct number values[func->numParams + 1];
+    size_t count = 0;
+
+    if (!consume(")", _interpreter))
+    {
+        do
+        {
+            struct number v = typedExpression(effects, _interpreter);
+            if (count == func->numParams)
+            {
+                fail(_interpreter);
+            }
+            values[count++] = v;
+        } while (consume(",", _interpreter));
+
+        if (!consume(")", _interpreter))
+        {
+            fail(_interpreter);
+        }
+    }
+
+    if (count != func->numParams)
+    {
+        fail(_interpreter);
+    }
+
+    // An integer host function takes the numbers as they are, a float is truncated
+    if (func->direct != NULL)
+    {
+        int64_t ints[func->numParams];
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t bits = values[i].value;
+            if (values[i].isFloat && !number_convert(values[i], int64, &bits))
+            {
+                fail(_interpreter);
+            }
+            ints[i] = bits;
+        }
+        resultKind = int64;
+        return effects ? callDirect(func, ints) : 0;
+    }
+
+    fun_value args[func->numParams + 1];
+    for (size_t i = 0; i < count; i++)
+    {
+        args[i] = values[i].isFloat ? fun_float(number_as_double(values[i])) : fun_int(values[i].value);
+    }
+
+    fun_value result = fun_int(0);
+    if (effects && !func->native(func->nativeData, args, count, &result))
+    {
+        char message[256];
+        snprintf(message, sizeof(message), "native function %s failed", name);
+        failWith(_interpreter, error_runtime, message);
+    }
+
+    if (result.type == FUN_FLOAT)
+    {
+        resultKind = float64;
+        return number_from_double(result.f).value;
+    }
+    resultKind = int64;
+    return result.i;
+}
+
+static uint64_t runFunction(bool effects, struct Interpreter *_interpreter, const char *name)
+{
+    return callFunction(effects, _interpreter, name, NULL);
+}
+
+// Run func, defined as name, in func_interpreter, the scope with its arguments bound, and free
+// the scope. If it returns an array, the array goes to *arrayResult (NULL there means it
+// returned an integer), or is dropped when arrayResult is NULL.
+static uint64_t runFunctionBody(struct Interpreter *func_interpreter, const char *name, struct Function *func, struct Array **arrayResult)
+{
+    struct optional_int ans;
+
+    // A memo fun only runs for numbers it hasn't seen yet
+    struct MemoCache *memo = memoFor(name, func);
+    uint64_t args[func->numParams + 1];
+    uint64_t floats;
+    bool cacheable = memo != NULL && memoArguments(func, func_interpreter, args, &floats);
+    number_kind kind;
+
+    if (cacheable && memo_lookup(memo, args, floats, &ans.value, &kind))
+    {
+        ans.present = true;
+        resultKind = kind;
+    }
+    else
+    {
+        // Run function
+        callDepth++;
+        ans.present = functionBody(func_interpreter);
+        ans.value = returnValue;
+        callDepth--;
+
+        // A returned array isn't cached, the caller gets a fresh one each time
+        if (cacheable && returnedArray == NULL)
+        {
+            memo_store(memo, args, floats, ans.present ? ans.value : 0, ans.present ? resultKind : uint64);
+        }
+    }
+
+    free_interpreter(func_interpreter);
+
+    struct Array *returned = returnedArray;
+    returnedArray = NULL;
+
+    if (arrayResult != NULL)
+    {
+        *arrayResult = returned;
+    }
+    else
+    {
+        heap_release(returned);
+    }
+
+    // Check if function has return value
+    if (ans.present)
+    {
+        return ans.value;
+    }
+    else
+    {
+        resultKind = uint64;
+        return 0;
+    }
+}
+
+// Function a call named id, right at the current position, runs, and its name in the function
+// table as *name. NULL if there is no such function. The name is looked up the first time the
+// call runs and kept in the brace table until a definition changes.
+static struct Function *resolveCall(struct Interpreter *_interpreter, struct Slice id, char const **name)
+{
+    struct CallSite *site = brace_call_site(_interpreter->braces, id.start - _interpreter->program);
+    if (site != NULL && site->func != NULL && site->generation == context->functionGeneration)
+    {
+        *name = site->name;
+        return site->func;
+    }
+
+    char key[id.len + 1];
+    memcpy(key, id.start, id.len);
+    key[id.len] = '\0';
+
+    struct FunctionPair *entry = function_entry(key);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    // Parallel workers share the table, they only read it
+    if (site != NULL && !inParallelRegion)
+    {
+        *site = (struct CallSite) {entry->value, entry->key, context->functionGeneration};
+    }
+    *name = entry->key;
+    return entry->value;
+}
+
+// Run func, defined as name, its arguments follow. If it returns an array, the array goes to
+// *arrayResult (NULL there means it returned an integer), or is dropped when arrayResult is NULL.
+static uint64_t callResolved(bool effects, struct Interpreter *_interpreter, const char *name, struct Function *func, struct Array **arrayResult)
+{
+    // A host function only returns numbers
+    if (func->native != NULL)
+    {
+        if (arrayResult != NULL)
+        {
+            *arrayResult = NULL;
+        }
+        return callNative(effects, _interpreter, name, func);
+    }
+
+    // A call counts as an operation, and calls only nest as deep as the limit and the stack allow
+    countOps(_interpreter, 1);
+    if (context->sandbox.limits.maxDepth != 0 && callDepth >= context->sandbox.limits.maxDepth)
+    {
+        failWith(_interpreter, error_depth, NULL);
+    }
+    if (stack_exhausted())
+    {
+        char message[96];
+        snprintf(message, sizeof(message), "out of stack space after %zu nested calls", callDepth);
+        failWith(_interpreter, error_depth, message);
+    }
+
+    char const *callSite = _interpreter->current;
+    struct Interpreter *func_interpreter = bindArguments(_interpreter, func);
+    func_interpreter->caller = _interpreter;
+    func_interpreter->function = name;
+    func_interpreter->callSite = callSite;
+
+    uint64_t value = runFunctionBody(func_interpreter, name, func, arrayResult);
+    runningScope = _interpreter;
+    return value;
+}
+
+// Run the function called name. If it returns an array, the array goes to *arrayResult
+// (NULL there means it returned an integer), or is dropped when arrayResult is NULL.
+static uint64_t callFunction(bool effects, struct Interpreter *_interpreter, const char *name, struct Array **arrayResult)
+{
+    struct Function *func = get_function(name);
+
+    // Check if function exists in map
+    if (func == NULL)
+    {
+        fail(_interpreter);
+    }
+
+    return callResolved(effects, _interpreter, name, func, arrayResult);
+}
+
+// True if only blanks are left before the end of the statement at p
+static bool atStatementEnd(char const *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+    {
+        p++;
+    }
+    return *p == '\n' || *p == '}' || *p == '\0';
+}
+
+// return <ARRAY> or return <FUNCTION>(...) of a function that returns an array. The array is
+// left in returnedArray for the caller, an integer the call returned instead goes to *value.
+// Returns false without consuming anything if the statement returns an integer expression.
+static bool returnArray(bool effects, struct Interpreter *_interpreter, uint64_t *value)
+{
+    char const *start = _interpreter->current;
+    struct optional_slice name = consume_identifier(_interpreter);
+
+    if (!name.present)
+    {
+        return false;
+    }
+
+    struct data_type *stored = lookupVariable(name.value, _interpreter);
+
+    if (stored != NULL && stored->curr_data_type == array && atStatementEnd(_interpreter->current))
+    {
+        if (effects)
+        {
+            returnedArray = array_share(stored->isArray);
+        }
+        return true;
+    }
+
+    // A call is only passed through when nothing else follows it
+    char char_id[name.value.len + 1];
+    memcpy(char_id, name.value.start, name.value.len);
+    char_id[name.value.len] = '\0';
+
+    if (effects && contains_function(char_id) && *_interpreter->current == '(')
+    {
+        size_t depth = 0;
+        char const *p = _interpreter->current;
+
+        do
+        {
+            depth += *p == '(';
+            depth -= *p == ')';
+            p++;
+        } while (depth > 0 && *p != '\0');
+
+        if (depth == 0 && atStatementEnd(p))
+        {
+            consume("(", _interpreter);
+            struct Array *result;
+            *value = callFunction(effects, _interpreter, char_id, &result);
+            returnedArray = result;
+            return true;
+        }
+    }
+
+    _interpreter->current = start;
+    return false;
+}
+
+// Entry point of every coroutine, runs the function it was spawned with on its own stack
+static void runCoroutine()
+{
+    struct Interpreter *self = context->running;
+    reap_zombie();
+
+    bool returned = functionBody(self);
+
+    // Threads only hand back integers
+    heap_release(returnedArray);
+    returnedArray = NULL;
+
+    // Every other coroutine is asleep, so nothing can ever wake them
+    if (!exit_coroutine(returned ? returnValue : 0))
+    {
+        fail(context->global);
+    }
+}
+
+// spawn <FUNCTION_NAME>(...) runs the function as a new coroutine, the arguments are evaluated right away
+static struct Coroutine *spawnFunction(bool effects, struct Interpreter *_interpreter)
+{
+    struct optional_slice name = consume_identifier(_interpreter);
+
+    if (!name.present || !consume("(", _interpreter) || inParallelRegion)
+    {
+        fail(_interpreter);
+    }
+
+    char *char_id = malloc(name.value.len + 1);
+    strncpy(char_id, name.value.start, name.value.len);
+    char_id[name.value.len] = '\0';
+
+    struct Function *func = get_function(char_id);
+    char const *function = function_name(char_id);
+    free(char_id);
+
+    if (func == NULL || func->native != NULL)
+    {
+        fail(_interpreter);
+    }
+
+    // The spawning function may be gone by the time the coroutine fails, so it has no caller
+    struct Interpreter *func_interpreter = bindArguments(_interpreter, func);
+    func_interpreter->function = function;
+    close_frame(func_interpreter);
+    return new_coroutine(func_interpreter, runCoroutine);
+}
+
+// Look up the variable named by the next identifier and check it has the given type
+static struct data_type *consumeTyped(struct Interpreter *_interpreter, variable_type type)
+{
+    struct optional_slice name = consume_identifier(_interpreter);
+    struct data_type *value = name.present ? lookupVariable(name.value, _interpreter) : NULL;
+
+    if (value == NULL || value->curr_data_type != type)
+    {
+        fail(_interpreter);
+    }
+
+    return value;
+}
+
+// What the workers of a parallel for share. Coroutines only run again once the loop is done, so
+// while it runs a channel that a worker waits on can only be changed by another worker.
+struct ParallelLoop
+{
+    _Atomic bool stop; // Set by the first worker that fails, the others stop at their next iteration
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // A worker changed a channel or finished
+    size_t running; // Workers that haven't finished
+    size_t asleep; // Workers waiting on a channel that haven't been woken since
+    uint64_t changes; // Times sleeping workers were woken
+};
+
+static __thread struct ParallelLoop *parallelLoop = NULL; // Loop the thread runs the body of, see inParallelRegion
+
+// Wake the workers of loop that sleep on a channel so they check it again
+static void loopChanged(struct ParallelLoop *loop)
+{
+    pthread_mutex_lock(&loop->lock);
+    if (loop->asleep > 0)
+    {
+        loop->asleep = 0;
+        loop->changes++;
+        pthread_cond_broadcast(&loop->changed);
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+// Sleep until another worker changed a channel, unless ch is ready by now. False if all the
+// others are asleep or done, then nothing would ever wake this one. Once another worker failed
+// the loop is stopped instead, without an error of its own.
+static bool sleepInLoop(struct ParallelLoop *loop, struct Channel *ch, bool (*ready)(struct Channel *))
+{
+    bool woken = true;
+    bool stopped = false;
+
+    pthread_mutex_lock(&loop->lock);
+    if (!ready(ch) && !atomic_load(&ch->closed))
+    {
+        if (atomic_load(&loop->stop))
+        {
+            stopped = true;
+        }
+        else if (loop->asleep + 1 == loop->running)
+        {
+            woken = false;
+        }
+        else
+        {
+            uint64_t changes = loop->changes;
+            loop->asleep++;
+            while (loop->changes == changes)
+            {
+                pthread_cond_wait(&loop->changed, &loop->lock);
+            }
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    if (stopped)
+    {
+        raise_error((struct RunError) {error_none, 0, 0, NULL});
+    }
+    return woken;
+}
+
+// Sleep until the channel may have changed, coroutines park and parallel for workers sleep until
+// another worker changed a channel. ready is rechecked under the loop's lock so a wakeup can't be missed.
+static void waitOnChannel(struct Interpreter *_interpreter, struct Channel *ch, Queue *waiters, bool (*ready)(struct Channel *))
+{
+    // Keep the channel alive even if its variable is redeclared while we sleep
+    heap_retain(ch);
+    bool woken = inParallelRegion ? sleepInLoop(parallelLoop, ch, ready) : park(waiters);
+    heap_release(ch);
+
+    if (!woken && inParallelRegion)
+    {
+        failWith(_interpreter, error_runtime, "every worker of the parallel for waits on a channel, coroutines only run once the loop is done");
+    }
+    else if (!woken)
+    {
+        // Nothing else can run to change the channel
+        fail(_interpreter);
+    }
+}
+
+// Tell whoever sleeps on waiters that the channel changed
+static void notifyChannel(struct Channel *ch, Queue *waiters, bool all)
+{
+    // Workers share the channel's queues with each other, what they wake waits in their own
+    // queue until the loop is done, see wokenQ
+    if (inParallelRegion)
+    {
+        pthread_mutex_lock(&ch->lock);
+    }
+
+    if (all)
+    {
+        wake_all(waiters);
+    }
+    else
+    {
+        wake(waiters);
+    }
+
+    if (inParallelRegion)
+    {
+        pthread_mutex_unlock(&ch->lock);
+        loopChanged(parallelLoop);
+    }
+}
+
+static void channelSend(struct Interpreter *_interpreter, struct Channel *ch, uint64_t value)
+{
+    while (true)
+    {
+        // Sending on a closed channel is an error
+        if (atomic_load(&ch->closed))
+        {
+            fail(_interpreter);
+        }
+
+        if (channel_try_send(ch, value))
+        {
+            notifyChannel(ch, &ch->receivers, false);
+            return;
+        }
+
+        waitOnChannel(_interpreter, ch, &ch->senders, channel_has_room);
+    }
+}
+
+// Returns false once the channel is closed and drained
+static bool channelRecv(struct Interpreter *_interpreter, struct Channel *ch, uint64_t *value)
+{
+    while (true)
+    {
+        if (channel_try_recv(ch, value))
+        {
+            notifyChannel(ch, &ch->senders, false);
+            return true;
+        }
+
+        // A value may have been sent just before the close
+        if (atomic_load(&ch->closed))
+        {
+            return channel_try_recv(ch, value);
+        }
+
+        waitOnChannel(_interpreter, ch, &ch->receivers, channel_has_value);
+    }
+}
+
+// Whether name is one of the sized integer types, which is stored in kind
+static bool parseNumberKind(struct Slice name, number_kind *kind)
+{
+    for (size_t i = 0; i < NUMBER_KINDS; i++)
+    {
+        if (operator1(number_kind_names[i], name))
+        {
+            *kind = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Set an integer variable, failing if value doesn't fit its kind
+static void storeInteger(struct Interpreter *_interpreter, struct data_type *target, uint64_t value)
+{
+    if (!number_fits(target->numType, value))
+    {
+        fail(_interpreter);
+    }
+    target->isInt = value;
+}
+
+// Return the stored value of a variable, local scope first, NULL if it doesn't exist
+static struct data_type *lookupVariable(struct Slice name, struct Interpreter *_interpreter)
+{
+    struct data_type *value = get_value_ref(name, _interpreter);
+    if (value == NULL)
+    {
+        value = get_value_ref(name, context->global);
+    }
+    return value;
+}
+
+// Fail if a parallel for body assigns a scalar that is shared by all of its iterations
+static void checkPrivateWrite(struct Slice id, struct Interpreter *_interpreter)
+{
+    if (!inParallelRegion)
+    {
+        return;
+    }
+
+    struct Pair *entry = get_pair(id, _interpreter);
+
+    if ((entry != NULL && entry->shared) || (entry == NULL && contains(id, context->global)))
+    {
+        fail(_interpreter);
+    }
+}
+
+// Look up the array named by the next identifier, local scope first
+static struct Array *consumeArray(struct Interpreter *_interpreter)
+{
+    struct optional_slice name = consume_identifier(_interpreter);
+
+    if (!name.present)
+    {
+        fail(_interpreter);
+    }
+
+    struct data_type *value = lookupVariable(name.value, _interpreter);
+
+    if (value == NULL || value->curr_data_type != array)
+    {
+        fail(_interpreter);
+    }
+
+    return value->isArray;
+}
+
+// Look up the array named by the next identifier to change its length, which a parallel for
+// body may only do to arrays it declared itself
+static struct Array *consumeArrayToResize(struct Interpreter *_interpreter, bool effects)
+{
+    struct optional_slice name = consume_identifier(_interpreter);
+    struct data_type *value = name.present ? lookupVariable(name.value, _interpreter) : NULL;
+
+    if (value == NULL || value->curr_data_type != array)
+    {
+        fail(_interpreter);
+    }
+    if (effects)
+    {
+        checkPrivateWrite(name.value, _interpreter);
+    }
+
+    return value->isArray;
+}
+
+// Look up the map named by the next identifier. With write set it must be one a parallel for body may change.
+static struct Map *consumeMap(struct Interpreter *_interpreter, bool write)
+{
+    struct optional_slice name = consume_identifier(_interpreter);
+    struct data_type *value = name.present ? lookupVariable(name.value, _interpreter) : NULL;
+
+    if (value == NULL || value->curr_data_type != map)
+    {
+        fail(_interpreter);
+    }
+    if (write)
+    {
+        checkPrivateWrite(name.value, _interpreter);
+    }
+
+    return value->isMap;
+}
+
+// Parse a map key. Text, string and view variables and the string built-ins make a string key,
+// anything else is an integer expression.
+static struct MapKey parseMapKey(bool effects, struct Interpreter *_interpreter)
+{
+    char const *start = _interpreter->current;
+    bool text = consume("\"", _interpreter);
+
+    if (!text)
+    {
+        struct optional_slice id = consume_identifier(_interpreter);
+        struct data_type *value = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+
+        text = value != NULL ? value->curr_data_type == string || value->curr_data_type == view
+                             : id.present && (operator1("readLine", id.value) || operator1("readFile", id.value));
+    }
+    _interpreter->current = start;
+
+    return text ? map_string_key(parseString(effects, _interpreter)) : map_int_key(expression(effects, _interpreter));
+}
+
+// Value stored in m under the key in m[key], 0 if there is none. current is just past the [.
+static uint64_t readMapEntry(bool effects, struct Interpreter *_interpreter, struct Map *m)
+{
+    struct MapKey key = parseMapKey(effects, _interpreter);
+    uint64_t value = 0;
+
+    if (!consume("]", _interpreter))
+    {
+        fail(_interpreter);
+    }
+    map_get(m, key, &value);
+    map_drop_key(key);
+    return value;
+}
+
+// Bits of v as an element of a. False if it doesn't fit, or for a float that isn't a whole number in an integer array.
+static bool toElement(struct number v, struct Array const *a, uint64_t *value)
+{
+    return number_convert(v, a->kind, value) && equalTo(number_of(*value, a->kind), v);
+}
+
+// Float array named by the next identifier
+static struct Array *consumeFloatArray(struct Interpreter *_interpreter)
+{
+    struct Array *a = consumeArray(_interpreter);
+    if (a->kind != float64)
+    {
+        fail(_interpreter);
+    }
+    return a;
+}
+
+// Runs the built-in array operation called name and stores its output in result.
+// Returns false if name is not a built-in.
+static bool runBuiltin(bool effects, struct Interpreter *_interpreter, const char *name, uint64_t *result)
+{
+    *result = 0;
+    number_kind kind = uint64; // Kind of *result, reported through resultKind once the call is complete
+
+    // fill(a, value)
+    if (strcmp(name, "fill") == 0)
+    {
+        struct Array *a = consumeArray(_interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        struct number v = typedExpression(effects, _interpreter);
+        uint64_t value;
+
+        if (effects)
+        {
+            if (!number_convert(v, a->kind, &value))
+            {
+                fail(_interpreter);
+            }
+            array_make_unique(a);
+            typed_fill(a, value);
+        }
+    }
+
+    // copy(dst, src), returns the number of elements copied. Every element must fit the kind of dst.
+    else if (strcmp(name, "copy") == 0)
+    {
+        struct Array *dst = consumeArray(_interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        struct Array *src = consumeArray(_interpreter);
+
+        size_t n = dst->length < src->length ? dst->length : src->length;
+        if (effects && dst->data != src->data)
+        {
+            array_make_unique(dst);
+            if (!typed_copy(dst, src, n))
+            {
+                fail(_interpreter);
+            }
+        }
+        *result = n;
+    }
+
+    // sum(a)
+    else if (strcmp(name, "sum") == 0)
+    {
+        struct Array *a = consumeArray(_interpreter);
+        *result = typed_sum(a);
+        kind = a->kind;
+    }
+
+    // min(a) and max(a), 0 for an empty array
+    else if (strcmp(name, "min") == 0 || strcmp(name, "max") == 0)
+    {
+        struct Array *a = consumeArray(_interpreter);
+        *result = typed_extreme(a, name[1] == 'a');
+        kind = a->kind;
+    }
+
+    // sqrt(x) and exp(x) of a number, or sqrt(a) and exp(a) replace every element of float array a
+    else if (strcmp(name, "sqrt") == 0 || strcmp(name, "exp") == 0)
+    {
+        char const *start = _interpreter->current;
+        struct optional_slice id = consume_identifier(_interpreter);
+        struct data_type *stored = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+
+        skip(_interpreter);
+
+        if (stored != NULL && stored->curr_data_type == array && *_interpreter->current == ')')
+        {
+            struct Array *a = stored->isArray;
+            if (a->kind != float64)
+            {
+                fail(_interpreter);
+            }
+            if (effects)
+            {
+                checkPrivateWrite(id.value, _interpreter);
+                array_make_unique(a);
+                (name[0] == 's' ? array_sqrt : array_exp)(a->data, a->length);
+            }
+            *result = a->length;
+        }
+        else
+        {
+            _interpreter->current = start;
+            double x = number_as_double(typedExpression(effects, _interpreter));
+            *result = number_from_double(name[0] == 's' ? sqrt(x) : exp_kernel(x)).value;
+            kind = float64;
+        }
+    }
+
+    // dot(a, b) of 2 float arrays of the same length
+    else if (strcmp(name, "dot") == 0)
+    {
+        struct Array *a = consumeFloatArray(_interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        struct Array *b = consumeFloatArray(_interpreter);
+
+        if (a->length != b->length)
+        {
+            fail(_interpreter);
+        }
+        *result = number_from_double(array_dot(a->data, b->data, a->length)).value;
+        kind = float64;
+    }
+
+    // mean(a) and variance(a) of a float array, the population variance. Both are NaN for an empty array.
+    else if (strcmp(name, "mean") == 0 || strcmp(name, "variance") == 0)
+    {
+        struct Array *a = consumeFloatArray(_interpreter);
+        double mean = array_float_sum(a->data, a->length) / a->length;
+
+        // Deviations from the mean are summed in a second pass, which loses less than sum(x^2) - n * mean^2
+        *result = number_from_double(name[0] == 'm' ? mean : array_square_deviation(a->data, a->length, mean) / a->length).value;
+        kind = float64;
+    }
+
+    // count(a, value)
+    else if (strcmp(name, "count") == 0)
+    {
+        struct Array *a = consumeArray(_interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        uint64_t value;
+        *result = toElement(typedExpression(effects, _interpreter), a, &value) ? typed_count(a, value) : 0;
+    }
+
+    // send(c, value) waits while the channel is full
+    else if (strcmp(name, "send") == 0)
+    {
+        struct Channel *ch = consumeTyped(_interpreter, channel)->isChannel;
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        uint64_t value = integerExpression(effects, _interpreter);
+        channelSend(_interpreter, ch, value);
+    }
+
+    // recv(c, x) waits for a value and stores it in x, returns 0 once c is closed and drained
+    else if (strcmp(name, "recv") == 0)
+    {
+        struct Channel *ch = consumeTyped(_interpreter, channel)->isChannel;
+        struct optional_slice target = consume(",", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+
+        if (!target.present)
+        {
+            fail(_interpreter);
+        }
+
+        uint64_t value;
+        *result = channelRecv(_interpreter, ch, &value);
+
+        if (*result)
+        {
+            struct data_type *stored = lookupVariable(target.value, _interpreter);
+
+            if (stored == NULL || stored->curr_data_type != integer)
+            {
+                fail(_interpreter);
+            }
+            checkPrivateWrite(target.value, _interpreter);
+            storeInteger(_interpreter, stored, value);
+        }
+    }
+
+    // close(c) wakes everyone waiting on channel c, close(fd) closes a file descriptor
+    else if (strcmp(name, "close") == 0)
+    {
+        char const *start = _interpreter->current;
+        struct optional_slice id = consume_identifier(_interpreter);
+        struct data_type *value = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+
+        if (value != NULL && value->curr_data_type == channel)
+        {
+            struct Channel *ch = value->isChannel;
+            atomic_store(&ch->closed, true);
+            notifyChannel(ch, &ch->receivers, true);
+            notifyChannel(ch, &ch->senders, true);
+        }
+        else
+        {
+            _interpreter->current = start;
+            uint64_t fd = expression(effects, _interpreter);
+            if (effects && close_fd(fd) < 0)
+            {
+                ioFail(_interpreter, "close");
+            }
+        }
+    }
+
+    // join(t) waits for a coroutine to finish and returns what its function returned
+    else if (strcmp(name, "join") == 0)
+    {
+        struct Coroutine *coroutine = consumeTyped(_interpreter, thread)->isThread;
+        heap_retain(coroutine);
+        struct Held *held = hold_value(heap_release, coroutine, context->running);
+
+        while (!coroutine->finished)
+        {
+            if (inParallelRegion || !park(&coroutine->joiners))
+            {
+                fail(_interpreter);
+            }
+        }
+        *result = coroutine->result;
+        let_go(held);
+        heap_release(coroutine);
+    }
+
+    // yield() lets the other coroutines run
+    else if (strcmp(name, "yield") == 0)
+    {
+        if (!inParallelRegion)
+        {
+            yield_coroutine();
+        }
+    }
+
+    // now() is a monotonic clock in nanoseconds
+    else if (strcmp(name, "now") == 0)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        *result = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // indexOf(a, value), the length of the array if value is missing
+    else if (strcmp(name, "indexOf") == 0)
+    {
+        struct Array *a = consumeArray(_interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        uint64_t value;
+        *result = toElement(typedExpression(effects, _interpreter), a, &value) ? typed_index_of(a, value) : a->length;
+    }
+
+    // nextLine(v, line) moves the first line of view v into view line, returns 0 once v is empty
+    else if (strcmp(name, "nextLine") == 0 || strcmp(name, "nextField") == 0)
+    {
+        struct optional_slice sourceName = consume_identifier(_interpreter);
+        struct data_type *source = sourceName.present ? lookupVariable(sourceName.value, _interpreter) : NULL;
+        struct optional_slice targetName = consume(",", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+        struct data_type *target = targetName.present ? lookupVariable(targetName.value, _interpreter) : NULL;
+
+        if (source == NULL || source->curr_data_type != view || target == NULL || target->curr_data_type != view)
+        {
+            fail(_interpreter);
+        }
+
+        // nextField(v, field, separator) does the same up to the next separator
+        char separator = '\0';
+        if (name[4] == 'F')
+        {
+            if (!consume(",", _interpreter))
+            {
+                fail(_interpreter);
+            }
+            char *text = parseString(effects, _interpreter);
+            separator = text[0];
+            heap_release(text);
+        }
+
+        if (effects)
+        {
+            checkPrivateWrite(sourceName.value, _interpreter);
+            checkPrivateWrite(targetName.value, _interpreter);
+            *result = name[4] == 'F' ? view_next_field(&source->isView, &target->isView, separator) : view_next_line(&source->isView, &target->isView);
+        }
+    }
+
+    // len(x) is the length of a view, string or array, or the number of keys in a map
+    else if (strcmp(name, "len") == 0)
+    {
+        struct optional_slice id = consume_identifier(_interpreter);
+        struct data_type *value = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+
+        if (value != NULL && value->curr_data_type == view)
+        {
+            *result = value->isView.text.len;
+        }
+        else if (value != NULL && value->curr_data_type == string)
+        {
+            *result = strlen(value->ifString);
+        }
+        else if (value != NULL && value->curr_data_type == array)
+        {
+            *result = value->isArray->length;
+        }
+        else if (value != NULL && value->curr_data_type == map)
+        {
+            *result = value->isMap->size;
+        }
+        else
+        {
+            fail(_interpreter);
+        }
+    }
+
+    // has(m, key) is 1 if map m holds key, delete(m, key) removes it and returns 1 if it was there
+    else if (strcmp(name, "has") == 0 || strcmp(name, "delete") == 0)
+    {
+        struct Map *m = consumeMap(_interpreter, name[0] == 'd' && effects);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        struct MapKey key = parseMapKey(effects, _interpreter);
+        uint64_t value;
+
+        if (name[0] == 'h')
+        {
+            *result = map_get(m, key, &value);
+        }
+        else if (effects)
+        {
+            *result = map_delete(m, key);
+        }
+        map_drop_key(key);
+    }
+
+    // reserve(x, n) makes room for n keys in map x or n elements in array x, so filling it doesn't
+    // have to grow it along the way
+    else if (strcmp(name, "reserve") == 0)
+    {
+        struct optional_slice id = consume_identifier(_interpreter);
+        struct data_type *value = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+
+        if (value == NULL || (value->curr_data_type != map && value->curr_data_type != array) || !consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        uint64_t size = expression(effects, _interpreter);
+
+        if (effects)
+        {
+            checkPrivateWrite(id.value, _interpreter);
+            if (value->curr_data_type == map)
+            {
+                map_reserve(value->isMap, size);
+            }
+            else
+            {
+                array_reserve(value->isArray, size);
+            }
+        }
+    }
+
+    // push(a, value) appends value to array a and returns its new length
+    else if (strcmp(name, "push") == 0)
+    {
+        struct Array *a = consumeArrayToResize(_interpreter, effects);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        struct number v = typedExpression(effects, _interpreter);
+        uint64_t value;
+
+        if (effects)
+        {
+            if (!number_convert(v, a->kind, &value))
+            {
+                fail(_interpreter);
+            }
+            array_push(a, value);
+            *result = a->length;
+        }
+    }
+
+    // pop(a) removes the last element of array a and returns it, a must not be empty
+    else if (strcmp(name, "pop") == 0)
+    {
+        struct Array *a = consumeArrayToResize(_interpreter, effects);
+
+        if (effects)
+        {
+            if (a->length == 0)
+            {
+                fail(_interpreter);
+            }
+            *result = array_get(a, --a->length);
+            kind = a->kind;
+        }
+    }
+
+    // resize(a, n) gives array a n elements, new ones are 0
+    else if (strcmp(name, "resize") == 0)
+    {
+        struct Array *a = consumeArrayToResize(_interpreter, effects);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        uint64_t length = expression(effects, _interpreter);
+
+        if (effects)
+        {
+            array_resize(a, length);
+        }
+    }
+
+    // nextKey(m, cursor, k) stores the next key of map m in k and advances cursor, which starts
+    // at 0. Returns 0 once every key was visited. Keys come in no particular order.
+    else if (strcmp(name, "nextKey") == 0)
+    {
+        struct Map *m = consumeMap(_interpreter, false);
+        struct optional_slice cursorName = consume(",", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+        struct data_type *cursor = cursorName.present ? lookupVariable(cursorName.value, _interpreter) : NULL;
+        struct optional_slice targetName = consume(",", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+        struct data_type *target = targetName.present ? lookupVariable(targetName.value, _interpreter) : NULL;
+
+        if (cursor == NULL || cursor->curr_data_type != integer || target == NULL)
+        {
+            fail(_interpreter);
+        }
+
+        if (effects)
+        {
+            checkPrivateWrite(cursorName.value, _interpreter);
+            checkPrivateWrite(targetName.value, _interpreter);
+
+            size_t at = cursor->isInt;
+            ptrdiff_t i = map_next(m, &at);
+            storeInteger(_interpreter, cursor, at);
+
+            if (i >= 0)
+            {
+                struct MapKey key = m->slots[i].key;
+
+                if (key.text != NULL && target->curr_data_type == string)
+                {
+                    heap_retain(key.text);
+                    heap_release(target->ifString);
+                    target->ifString = key.text;
+                }
+                else if (key.text == NULL && target->curr_data_type == integer)
+                {
+                    storeInteger(_interpreter, target, key.number);
+                }
+                else
+                {
+                    fail(_interpreter);
+                }
+                *result = 1;
+            }
+        }
+    }
+
+    // toInt(v) reads the decimal number at the start of view v
+    else if (strcmp(name, "toInt") == 0)
+    {
+        *result = view_to_int(consumeTyped(_interpreter, view)->isView.text);
+    }
+
+    // find(v, text) is the position of text in view v, or len(v) if it isn't there
+    // equals(v, text) is 1 if view v holds exactly text
+    else if (strcmp(name, "find") == 0 || strcmp(name, "equals") == 0)
+    {
+        struct Slice haystack = consumeTyped(_interpreter, view)->isView.text;
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        char *needle = parseString(effects, _interpreter);
+        size_t length = strlen(needle);
+
+        if (name[0] == 'f')
+        {
+            *result = view_find(haystack, needle, length);
+        }
+        else
+        {
+            *result = haystack.len == length && (length == 0 || memcmp(haystack.start, needle, length) == 0);
+        }
+        heap_release(needle);
+    }
+
+    // writeFile(path, text) replaces the file with text and returns the bytes written
+    else if (strcmp(name, "writeFile") == 0)
+    {
+        char *path = parseString(effects, _interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        char *text = parseString(effects, _interpreter);
+
+        if (effects)
+        {
+            struct IoJob job = {job_write, path, text, strlen(text)};
+            submit_job(&job, !inParallelRegion);
+            if (job.error != 0)
+            {
+                errno = job.error;
+                ioFail(_interpreter, path);
+            }
+            *result = job.length;
+        }
+        heap_release(path);
+        heap_release(text);
+    }
+
+    // writeLine(fd, text) writes text and a newline, suspending while the pipe or socket is full
+    else if (strcmp(name, "writeLine") == 0)
+    {
+        uint64_t fd = expression(effects, _interpreter);
+        if (!consume(",", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        char *text = parseString(effects, _interpreter);
+
+        if (effects)
+        {
+            size_t length = strlen(text);
+            text[length] = '\n';
+            if (!write_all(fd, text, length + 1, !inParallelRegion))
+            {
+                ioFail(_interpreter, "writeLine");
+            }
+            *result = length + 1;
+        }
+        heap_release(text);
+    }
+
+    // eof(fd) is 1 once readLine(fd) has run out of input
+    else if (strcmp(name, "eof") == 0)
+    {
+        uint64_t fd = expression(effects, _interpreter);
+        *result = effects ? at_eof(fd) : 0;
+    }
+
+    // listen(path) creates a Unix domain socket at path and returns its descriptor
+    else if (strcmp(name, "listen") == 0)
+    {
+        char *path = parseString(effects, _interpreter);
+        if (effects && (*result = listen_unix(path)) == (uint64_t) -1)
+        {
+            ioFail(_interpreter, path);
+        }
+        heap_release(path);
+    }
+
+    // accept(fd) suspends until a client connects to a listening socket
+    else if (strcmp(name, "accept") == 0)
+    {
+        uint64_t fd = expression(effects, _interpreter);
+        if (effects && (*result = accept_unix(fd, !inParallelRegion)) == (uint64_t) -1)
+        {
+            ioFail(_interpreter, "accept");
+        }
+    }
+
+    // connect(path) connects to a listening Unix domain socket
+    else if (strcmp(name, "connect") == 0)
+    {
+        char *path = parseString(effects, _interpreter);
+        if (effects && (*result = connect_unix(path, !inParallelRegion)) == (uint64_t) -1)
+        {
+            ioFail(_interpreter, path);
+        }
+        heap_release(path);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (!consume(")", _interpreter))
+    {
+        fail(_interpreter);
+    }
+    resultKind = kind;
+    return true;
+}
+
+// Runs the built-in called name if it produces a string and returns a copy the caller frees.
+// Returns NULL if name is not a string built-in.
+static char *runStringBuiltin(bool effects, struct Interpreter *_interpreter, const char *name)
+{
+    char *text;
+
+    // readFile(path) returns the whole file
+    if (strcmp(name, "readFile") == 0)
+    {
+        char *path = parseString(effects, _interpreter);
+
+        if (effects)
+        {
+            struct IoJob job = {job_read, path};
+            submit_job(&job, !inParallelRegion);
+            if (job.data == NULL)
+            {
+                errno = job.error;
+                ioFail(_interpreter, path);
+            }
+            text = job.data;
+        }
+        else
+        {
+            text = strdup("");
+        }
+        heap_release(path);
+    }
+
+    // readLine() reads the next line of standard input, readLine(fd) of a pipe or socket
+    else if (strcmp(name, "readLine") == 0)
+    {
+        uint64_t fd = *_interpreter->current == ')' ? STDIN_FILENO : expression(effects, _interpreter);
+
+        text = effects ? read_line(fd, !inParallelRegion) : strdup("");
+        if (text == NULL)
+        {
+            ioFail(_interpreter, "readLine");
+        }
+    }
+    else
+    {
+        return NULL;
+    }
+
+    if (!consume(")", _interpreter))
+    {
+        fail(_interpreter);
+    }
+    return text;
+}
+
+// This method skips through text until a closing bracket is reached, while noting for another parentheses in between
+static void clearUntilClosingBracket(struct Interpreter *_interpreter)
+{
+    size_t count = 1;
+
+    char const *current = _interpreter->current;
+
+    // Right after its { the brace table knows where a block ends
+    if (current > _interpreter->program && current[-1] == '{')
+    {
+        size_t end = brace_match(_interpreter->braces, current - 1 - _interpreter->program);
+        if (end != 0)
+        {
+            _interpreter->current = _interpreter->program + end;
+            return;
+        }
+    }
+
+    while (true)
+    {
+        if (*current == '"')
+        {
+            // Braces in a string literal don't count
+            current = strchr(current + 1, '"');
+            if (current == NULL)
+            {
+                fail(_interpreter);
+            }
+        }
+        else if (*current == '{')
+        {
+            count++;
+        }
+        else if (*current == '}')
+        {
+            count--;
+        }
+
+        if (*current == '\0' || count < 0)
+        {
+            fail(_interpreter);
+        }
+
+        current += 1;
+
+        if (count == 0)
+        {
+            break;
+        }
+    }
+
+    _interpreter->current = current;
+}
+
+// Return text until closing bracket is found, account for other opening/closing brackets in between
+static char *getUntilClosingBracket(struct Interpreter *_interpreter)
+{
+    char const *start = _interpreter->current;
+    clearUntilClosingBracket(_interpreter);
+
+    // Everything up to the closing bracket, which is left out
+    return strndup(start, _interpreter->current - 1 - start);
+}
+
+// This method returns text until a closing parenthesis is reached, accounting for other parens in between
+static char *clearUntilClosingParen(struct Interpreter *_interpreter, size_t count)
+{
+    skip(_interpreter);
+    // Skip through if else
+    size_t i = 0;
+
+    char const *current = _interpreter->current;
+
+    char *currString = malloc(1); // Room for the terminator of an empty string
+
+    size_t maxSize = 1;
+
+    while (true)
+    {
+        char const found = current[i];
+
+        if (found == '\0')
+        {
+            fail(_interpreter);
+        }
+        else if (found == '(')
+        {
+            count++;
+        }
+        else if (found == ')')
+        {
+            count--;
+        }
+
+	// Have we reached the final closing paren?
+        if (count == 0)
+        {
+            break;
+        }
+
+	// If we reach max size, reallocate more memory for the string
+        if (i + 1 >= maxSize)
+        {
+            maxSize = maxSize * 2 + 1;
+            currString = realloc(currString, sizeof(char) * maxSize);
+        }
+
+        currString[i] = found;
+
+        i++;
+    }
+
+    if (currString != NULL)
+    {
+        currString[i] = '\0';
+    }
+
+    current += i;
+    _interpreter->current = current;
+
+    return currString;
+}
+
+// Built-ins whose only effects are on the arrays and maps passed to them
+static char const *const pureBuiltins[] = {"len", "sum", "min", "max", "count", "indexOf", "sqrt", "exp", "dot", "mean", "variance",
+                                    "has", "delete", "fill", "copy", "push", "pop", "resize", "reserve", NULL};
+
+static char const *const pureKeywords[] = {"if", "else", "while", "for", "break", "continue", "return", "true", "false", NULL};
+
+static bool isTypeName(struct Slice name)
+{
+    number_kind kind;
+    return operator1("integer", name) || operator1("boolean", name) || operator1("string", name) ||
+           operator1("array", name) || operator1("map", name) || parseNumberKind(name, &kind);
+}
+
+static bool inWordList(char const *const *list, struct Slice word)
+{
+    for (size_t i = 0; list[i] != NULL; i++)
+    {
+        if (operator1(list[i], word))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Next identifier at or after *p that isn't inside a string or number literal, false at the end of code
+static bool nextWord(char const **p, struct Slice *word)
+{
+    char const *current = *p;
+    while (*current)
+    {
+        if (*current == '"')
+        {
+            current = strchr(current + 1, '"');
+            if (current == NULL)
+            {
+                return false;
+            }
+            current++;
+        }
+        else if (isdigit(*current))
+        {
+            // Also skips the rest of 1.5 or 2e3
+            while (isalnum(*current) || *current == '.')
+            {
+                current++;
+            }
+        }
+        else if (isalpha(*current))
+        {
+            char const *start = current;
+            while (isalnum(*current))
+            {
+                current++;
+            }
+            *word = new_slice2(start, current);
+            *p = current;
+            return true;
+        }
+        else
+        {
+            current++;
+        }
+    }
+    return false;
+}
+
+// Whether the result of func, defined as name, only depends on its arguments: it only uses its parameters
+// and its own variables, and only calls itself, pure functions and the built-ins above. depth counts the calls
+// followed to get here, past the number of functions the path has come back to one that is checked already.
+static bool isPure(char const *name, struct Function const *func, size_t depth)
+{
+    if (depth > context->functionsSize)
+    {
+        return true;
+    }
+
+    // Variables declared in the body, each follows its type
+    size_t numLocals = 0;
+    struct Slice *locals = NULL;
+    char const *p = func->code;
+    struct Slice word;
+    bool typed = false;
+
+    while (nextWord(&p, &word))
+    {
+        if (typed)
+        {
+            locals = realloc(locals, (numLocals + 1) * sizeof(struct Slice));
+            locals[numLocals++] = word;
+        }
+        typed = isTypeName(word);
+    }
+
+    bool pure = true;
+    p = func->code;
+    while (pure && nextWord(&p, &word))
+    {
+        bool known = inWordList(pureKeywords, word) || isTypeName(word);
+        for (size_t i = 0; !known && i < func->numParams; i++)
+        {
+            known = operator1(func->params[i], word);
+        }
+        for (size_t i = 0; !known && i < numLocals; i++)
+        {
+            known = operator2(locals[i], word);
+        }
+
+        char const *after = p;
+        while (isspace(*after))
+        {
+            after++;
+        }
+        if (!known && *after == '(')
+        {
+            char *callee = strndup(word.start, word.len);
+            struct Function *calleeFunc = get_function(callee);
+
+            // The host functions may do anything
+            known = strcmp(callee, name) == 0 || inWordList(pureBuiltins, word) ||
+                    (calleeFunc != NULL && calleeFunc->native == NULL && isPure(callee, calleeFunc, depth + 1));
+            free(callee);
+        }
+        pure = known;
+    }
+
+    free(locals);
+    return pure;
+}
+
+// Cache of func if it is a memo fun that is still pure. After any definition changed the results
+// are dropped and the check is repeated, since a function it calls may be different now.
+static struct MemoCache *memoFor(char const *name, struct Function const *func)
+{
+    struct MemoCache *memo = func->memo;
+    if (memo == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&memo->lock);
+    if (memo->generation != context->functionGeneration)
+    {
+        memo_clear(memo);
+        memo->generation = context->functionGeneration;
+        memo->pure = isPure(name, func, 0);
+    }
+    bool pure = memo->pure;
+    pthread_mutex_unlock(&memo->lock);
+
+    return pure ? memo : NULL;
+}
+
+// Arguments bound for func as a cache key, false if one isn't a number
+static bool memoArguments(struct Function const *func, struct Interpreter *func_interpreter, uint64_t *args, uint64_t *floats)
+{
+    *floats = 0;
+    for (size_t i = 0; i < func->numParams; i++)
+    {
+        struct data_type *value = get_value_ref(new_slice1(func->params[i], strlen(func->params[i])), func_interpreter);
+        if (value == NULL || value->curr_data_type != integer)
+        {
+            return false;
+        }
+        args[i] = value->isInt;
+        *floats |= (uint64_t) (value->numType == float64) << i;
+    }
+    return true;
+}
+
+// memo fun, a variable called memo is left alone
+static bool consumeMemoFun(struct Interpreter *_interpreter)
+{
+    char const *start = _interpreter->current;
+    if (consume("memo ", _interpreter) && consume("fun ", _interpreter))
+    {
+        return true;
+    }
+    _interpreter->current = start;
+    return false;
+}
+
+// fun name(...) { ... }, or memo fun with memo set
+static void parseFunction(bool effects, struct Interpreter *_interpreter, bool memo)
+{
+    skip(_interpreter);
+
+    // Get name of function
+    struct optional_slice test_func_name = consume_identifier(_interpreter);
+
+    if (!test_func_name.present) {
+        fail(_interpreter);
+    }
+
+    struct Slice id = test_func_name.value;
+
+    char *function_name = (char *)malloc(id.len + 1);
+    strncpy(function_name, id.start, id.len);
+    function_name[id.len] = '\0';
+
+    consume("(", _interpreter);
+
+    // Get parameters of function
+    char *allParameters = clearUntilClosingParen(_interpreter, 1);
+    consume(")", _interpreter);
+    consume("{", _interpreter);
+
+    char *rest; // strtok_r state, programs on other threads may be parsing theirs
+    char *buffer = strtok_r(allParameters, ",", &rest);
+    char **parameters = malloc(0); // Store all parameters in char of pointers of pointeres
+    size_t i = 0;
+
+    // Delimit parameters with comma
+    while (buffer)
+    {
+        parameters = realloc(parameters, (i + 1) * sizeof(char *));
+        parameters[i] = malloc(strlen(buffer) + 1);
+        strcpy(parameters[i], buffer);
+
+        buffer = strtok_r(NULL, ",", &rest);
+        while (buffer && *buffer == '\040')
+        {
+            buffer++;
+        }
+        i++;
+    }
+    free(allParameters);
+
+    // Code within function
+    size_t origin = _interpreter->origin + (_interpreter->current - _interpreter->program);
+    char *code = getUntilClosingBracket(_interpreter);
+
+    // Create function struct
+    struct Function *func = (struct Function *)malloc(sizeof(struct Function));
+    func->code = code;
+    func->params = parameters;
+    func->numParams = i;
+    func->memo = NULL;
+    func->braces = programBraces(code, strlen(code), origin);
+    func->origin = origin;
+    func->native = NULL;
+    func->nativeData = NULL;
+
+    // A memo fun must be pure when it is defined, its arguments are the key of one 64 bit mask
+    if (memo)
+    {
+        if (i > 64 || !isPure(function_name, func, 0))
+        {
+            // Point at the function rather than the end of its body
+            _interpreter->current = id.start;
+            fail(_interpreter);
+        }
+        func->memo = new_memo(i);
+        func->memo->generation = context->functionGeneration;
+    }
+
+    // Add function to function hashmap
+    insert_function(function_name, func);
+}
+
+// Move past the closing brace of a loop body that starts at bodyStart. *bodyEnd caches where
+// that is, so without a brace table only the first exit scans for the brace.
+static void skipLoopBody(char const *bodyStart, char const **bodyEnd, struct Interpreter *_interpreter)
+{
+    if (*bodyEnd == NULL)
+    {
+        _interpreter->current = bodyStart;
+        clearUntilClosingBracket(_interpreter);
+        *bodyEnd = _interpreter->current;
+    }
+    _interpreter->current = *bodyEnd;
+}
+
+// Run one iteration of a loop body, which starts at current. A body that runs to its closing
+// brace records where it ends, a break or continue jumps there. Returns flow_return, flow_break,
+// or flow_next for the next iteration.
+static flow runLoopBody(bool effects, char const **bodyEnd, struct Interpreter *_interpreter)
+{
+    char const *bodyStart = _interpreter->current;
+    flow result = statements(effects, _interpreter);
+
+    if (result == flow_end && _interpreter->current[-1] == '}')
+    {
+        *bodyEnd = _interpreter->current;
+        return flow_next;
+    }
+    if (result == flow_break || result == flow_continue)
+    {
+        skipLoopBody(bodyStart, bodyEnd, _interpreter);
+    }
+    return result == flow_return || result == flow_break ? result : flow_next;
+}
+
+// parses while loops
+static flow parseWhile(bool effects, struct Interpreter *_interpreter)
+{
+    char const *current = _interpreter->current;
+    char const *bodyEnd = NULL; // Just past the closing brace of the body, once known
+
+    while (true)
+    {
+        bool trueOrFalse = conditionHolds(effects, _interpreter, true); // Get the boolean condition
+
+        if (trueOrFalse) // If condition is true, run the code inside
+        {
+            flow result = runLoopBody(effects, &bodyEnd, _interpreter);
+            if (result != flow_next)
+            {
+                return result == flow_return ? flow_return : flow_next;
+            }
+        }
+        else // Condition is not true anymore
+        {
+            skipLoopBody(_interpreter->current, &bodyEnd, _interpreter);
+            return flow_next;
+        }
+
+        // Back to the condition, where a limit that runs out is reported
+        _interpreter->current = current;
+        countOps(_interpreter, 1);
+    }
+}
+
+// Most statements a loop body may have and still be vectorized
+#define MAX_VECTOR_STATEMENTS 16
+
+// Element-wise statement dst[i] = a op b in the body of a vectorizable loop
+struct VectorStatement
+{
+    struct Slice dst;
+    struct Slice names[2]; // Variable behind each operand, empty for literals
+    struct Operand operands[2];
+    char op; // '+', '-', '*', or 0 for a plain copy
+};
+
+// Parse one operand of an element-wise statement: a literal, a scalar, the induction variable or array[induction]
+static bool matchOperand(struct Interpreter *_interpreter, struct Slice induction, struct Slice *name, struct Operand *operand)
+{
+    struct optional_int literal_ = consume_literal(_interpreter);
+
+    if (literal_.present)
+    {
+        name->len = 0;
+        operand->kind = operand_scalar;
+        operand->value = literal_.value;
+        return true;
+    }
+
+    struct optional_slice id = consume_identifier(_interpreter);
+
+    if (!id.present || operator1("true", id.value) || operator1("false", id.value))
+    {
+        return false;
+    }
+    *name = id.value;
+
+    if (consume("[", _interpreter))
+    {
+        struct optional_slice index = consume_identifier(_interpreter);
+        operand->kind = operand_array;
+        return index.present && operator2(index.value, induction) && consume("]", _interpreter);
+    }
+
+    skip(_interpreter);
+    if (*_interpreter->current == '(')
+    {
+        return false;
+    }
+
+    operand->kind = operator2(id.value, induction) ? operand_index : operand_scalar;
+    return true;
+}
+
+// Fill in an operand from the variables it names, false if they can't be used by a kernel
+static bool resolveOperand(struct Interpreter *_interpreter, struct Slice name, struct Operand *operand, size_t start, size_t end)
+{
+    if (operand->kind == operand_index)
+    {
+        operand->value = start;
+        return true;
+    }
+    if (name.len == 0)
+    {
+        return true;
+    }
+
+    struct data_type *value = lookupVariable(name, _interpreter);
+
+    if (value == NULL)
+    {
+        return false;
+    }
+
+    if (operand->kind == operand_array)
+    {
+        if (value->curr_data_type != array || value->isArray->kind != uint64 || value->isArray->length < end)
+        {
+            return false;
+        }
+        operand->data = (uint64_t *) value->isArray->data + start;
+        return true;
+    }
+
+    // The kernels wrap around, signed values need the checked arithmetic of the interpreter
+    if (value->curr_data_type == integer && value->numType == uint64)
+    {
+        operand->value = value->isInt;
+        return true;
+    }
+    if (value->curr_data_type == boolean)
+    {
+        operand->value = value->isBool ? 1 : 0;
+        return true;
+    }
+    return false;
+}
+
+// Run "for(integer i = a; i < b; i = i + 1) { x[i] = y[i] + z[i] ... }" with SIMD kernels.
+// Every statement writes an array at the induction variable from operands indexed by it, so there are
+// no dependencies between iterations and each statement can run over the whole range before the next.
+// Returns false, leaving current at the loop header, if the loop doesn't have this shape. loop is
+// where the statement starts, for --diagnostics. Not inlined into parseFor, see there.
+__attribute__((noinline))
+static bool tryVectorizeFor(bool effects, struct Interpreter *_interpreter, char const *loop)
+{
+    char const *header = _interpreter->current;
+
+    if (!effects)
+    {
+        return false;
+    }
+
+    // integer i = <init>;
+    if (!consume("integer", _interpreter))
+    {
+        return false;
+    }
+
+    struct optional_slice induction = consume_identifier(_interpreter);
+
+    if (!induction.present || !consume("=", _interpreter))
+    {
+        _interpreter->current = header;
+        return false;
+    }
+
+    char const *init = _interpreter->current;
+    while (*_interpreter->current != ';' && *_interpreter->current != '\0')
+    {
+        _interpreter->current++;
+    }
+
+    // i < bound; or i <= bound;
+    struct Slice boundName = {NULL, 0};
+    struct Operand bound;
+    struct optional_slice condition = (consume(";", _interpreter)) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+    bool inclusive = false;
+
+    if (!condition.present || !operator2(condition.value, induction.value) || !consume("<", _interpreter))
+    {
+        _interpreter->current = header;
+        return false;
+    }
+    inclusive = consume("=", _interpreter);
+
+    if (!matchOperand(_interpreter, induction.value, &boundName, &bound) || bound.kind != operand_scalar || !consume(";", _interpreter))
+    {
+        _interpreter->current = header;
+        return false;
+    }
+
+    // i = i + 1) {
+    struct optional_slice update = consume_identifier(_interpreter);
+    bool matched = update.present && operator2(update.value, induction.value) && consume("=", _interpreter);
+
+    if (matched)
+    {
+        update = consume_identifier(_interpreter);
+        matched = update.present && operator2(update.value, induction.value) && consume("+", _interpreter);
+    }
+    if (matched)
+    {
+        struct optional_int step = consume_literal(_interpreter);
+        matched = step.present && step.value == 1 && consume(")", _interpreter) && consume("{", _interpreter);
+    }
+
+    // Body of element-wise statements
+    struct VectorStatement body[MAX_VECTOR_STATEMENTS];
+    size_t numStatements = 0;
+
+    while (matched && !consume("}", _interpreter))
+    {
+        struct VectorStatement *s = &body[numStatements];
+        struct optional_slice dst = consume_identifier(_interpreter);
+        struct optional_slice index;
+
+        matched = numStatements < MAX_VECTOR_STATEMENTS && dst.present && consume("[", _interpreter);
+        if (matched)
+        {
+            index = consume_identifier(_interpreter);
+            matched = index.present && operator2(index.value, induction.value) && consume("]", _interpreter) && consume("=", _interpreter) && *_interpreter->current != '=';
+        }
+        if (matched)
+        {
+            s->dst = dst.value;
+            s->op = 0;
+            s->operands[1].kind = operand_scalar;
+            s->operands[1].value = 0;
+            s->names[1].len = 0;
+            matched = matchOperand(_interpreter, induction.value, &s->names[0], &s->operands[0]);
+        }
+        if (matched)
+        {
+            if (consume("+", _interpreter))
+            {
+                s->op = '+';
+            }
+            else if (consume("-", _interpreter))
+            {
+                s->op = '-';
+            }
+            else if (consume("*", _interpreter))
+            {
+                s->op = '*';
+            }
+
+            if (s->op != 0)
+            {
+                matched = matchOperand(_interpreter, induction.value, &s->names[1], &s->operands[1]);
+            }
+        }
+        numStatements++;
+    }
+
+    char const *after = _interpreter->current;
+
+    if (!matched || numStatements == 0)
+    {
+        _interpreter->current = header;
+        return false;
+    }
+    checkPrivateWrite(induction.value, _interpreter);
+
+    // The loop bound must be a plain integer, it is read once instead of every iteration
+    if (!resolveOperand(_interpreter, boundName, &bound, 0, 0) || (inclusive && bound.value == UINT64_MAX))
+    {
+        _interpreter->current = header;
+        return false;
+    }
+
+    // Start the same way parseFor does, an existing induction variable keeps its value
+    uint64_t start;
+
+    if (contains(induction.value, _interpreter))
+    {
+        start = get_value(induction.value, _interpreter).isInt;
+    }
+    else
+    {
+        _interpreter->current = init;
+        start = expression(effects, _interpreter);
+
+        // Record the start so a fallback to parseFor doesn't evaluate the initializer twice
+        struct data_type startValue = {integer, "\0", start, false};
+        insert_pair(induction.value, startValue, _interpreter);
+    }
+
+    uint64_t end = inclusive ? bound.value + 1 : bound.value;
+    if (end < start)
+    {
+        end = start;
+    }
+
+    // Arrays about to be written stop sharing their elements first, so operands see the final storage
+    for (size_t i = 0; effects && i < numStatements; i++)
+    {
+        struct data_type *dst = lookupVariable(body[i].dst, _interpreter);
+
+        if (dst != NULL && dst->curr_data_type == array)
+        {
+            array_make_unique(dst->isArray);
+        }
+    }
+
+    // Every access must be in bounds and every name must still be usable by the kernels
+    for (size_t i = 0; i < numStatements; i++)
+    {
+        struct VectorStatement *s = &body[i];
+        struct data_type *dst = lookupVariable(s->dst, _interpreter);
+
+        if (dst == NULL || dst->curr_data_type != array || dst->isArray->kind != uint64 || dst->isArray->length < end
+            || !resolveOperand(_interpreter, s->names[0], &s->operands[0], start, end)
+            || !resolveOperand(_interpreter, s->names[1], &s->operands[1], start, end))
+        {
+            _interpreter->current = header;
+            return false;
+        }
+
+        // Arrays sharing storage are only safe if they line up element for element
+        for (int j = 0; j < 2; j++)
+        {
+            uint64_t const *src = s->operands[j].data;
+            uint64_t const *dstData = (uint64_t const *) dst->isArray->data + start;
+
+            if (s->operands[j].kind == operand_array && src != dstData && src < dstData + (end - start) && dstData < src + (end - start))
+            {
+                _interpreter->current = header;
+                return false;
+            }
+        }
+    }
+
+    // Counted as the iterations the scalar loop would have run
+    countOps(_interpreter, end - start);
+
+    for (size_t i = 0; i < numStatements; i++)
+    {
+        struct VectorStatement *s = &body[i];
+        struct data_type *dst = lookupVariable(s->dst, _interpreter);
+
+        array_map((uint64_t *) dst->isArray->data + start, s->operands[0], s->operands[1], s->op, end - start);
+    }
+
+    // The induction variable ends where the scalar loop would have left it
+    struct data_type endValue = {integer, "\0", end, false};
+    insert_pair(induction.value, endValue, _interpreter);
+
+    if (diagnostics)
+    {
+        source_print_location(&context->source, stderr, _interpreter->origin + (loop - _interpreter->program));
+        fprintf(stderr, ": vectorized loop, %zu statement%s, %zu iterations\n", numStatements, numStatements == 1 ? "" : "s",
+                (size_t) (end - start));
+    }
+
+    _interpreter->current = after;
+    return true;
+}
+
+// parses for loops, the statement starts at loop. Kept out of statement, which every nested call
+// goes through, so that its locals don't cost stack on each call.
+__attribute__((noinline))
+static flow parseFor(bool effects, struct Interpreter *_interpreter, char const *loop)
+{
+    char const *current = _interpreter->current;
+    char const *bodyEnd = NULL; // Just past the closing brace of the body, once known
+
+    if (tryVectorizeFor(effects, _interpreter, loop))
+    {
+        return flow_next;
+    }
+
+    while (true)
+    {
+        skip(_interpreter);
+
+        char const *program = _interpreter->program;
+        struct FastSite *site = effects ? fastSite(_interpreter) : NULL;
+        uint64_t trueOrFalse;
+        struct Slice variableName2;
+        uint64_t variableData2;
+
+        if (site != NULL && site->kind == site_for)
+        {
+            // The header ran before, each part is evaluated where it starts
+            struct ForHeader const *header = &site->header;
+            struct Slice induction = new_slice1(program + header->induction, header->inductionLength);
+            uint64_t variableData;
+
+            if (contains(induction, _interpreter)) {
+                variableData = get_value(induction, _interpreter).isInt;
+            } else {
+                _interpreter->current = program + header->init;
+                variableData = expression(effects, _interpreter);
+            }
+
+            struct data_type variableDataType = {integer, "\0", variableData, false};
+            checkPrivateWrite(induction, _interpreter);
+            insert_pair(induction, variableDataType, _interpreter);
+
+            _interpreter->current = program + header->condition;
+            trueOrFalse = conditionHolds(effects, _interpreter, false);
+
+            variableName2 = new_slice1(program + header->target, header->targetLength);
+            _interpreter->current = program + header->update;
+            variableData2 = expression(effects, _interpreter);
+
+            _interpreter->current = program + header->body;
+        }
+        else
+        {
+            // Where each part starts, kept once the header ran FUSE_AFTER times
+            struct ForHeader header;
+
+            if (!consume("integer", _interpreter)) {
+                fail(_interpreter);
+            }
+
+            struct optional_slice variableName = consume_identifier(_interpreter); // checks for initializes of variable incrementer
+
+            if (!variableName.present || !consume("=", _interpreter)) {
+                fail(_interpreter);
+            }
+            header.induction = variableName.value.start - program;
+            header.inductionLength = variableName.value.len;
+            header.init = _interpreter->current - program;
+
+            uint64_t variableData = 0;
+
+            if (contains(variableName.value, _interpreter)) {
+                variableData = get_value(variableName.value, _interpreter).isInt;
+
+                while (*_interpreter->current != ';') {
+                    _interpreter->current++;
+                }
+            } else {
+                variableData = expression(effects, _interpreter);
+            }
+
+            struct data_type variableDataType = {integer, "\0", variableData, false};
+
+            checkPrivateWrite(variableName.value, _interpreter);
+            insert_pair(variableName.value, variableDataType, _interpreter);
+
+            if (!consume(";", _interpreter)) {
+                fail(_interpreter);
+            }
+            header.condition = _interpreter->current - program;
+
+            trueOrFalse = expression(effects, _interpreter); // Get the boolean condition
+
+            if (!consume(";", _interpreter)) {
+                fail(_interpreter);
+            }
+
+            struct optional_slice target = consume_identifier(_interpreter);
+
+            if (!target.present || !consume("=", _interpreter)) {
+                fail(_interpreter);
+            }
+            variableName2 = target.value;
+            header.target = variableName2.start - program;
+            header.targetLength = variableName2.len;
+            header.update = _interpreter->current - program;
+
+            variableData2 = expression(effects, _interpreter);
+
+            consume(")", _interpreter);
+            consume("{", _interpreter);
+            header.body = _interpreter->current - program;
+
+            if (site != NULL && fuseNow(site))
+            {
+                site->kind = site_for;
+                site->header = header;
+            }
+        }
+
+        struct data_type variableDataType2 = {integer, "\0", variableData2, false};
+
+        if (trueOrFalse != 0) // If condition is true, run the code inside
+        {
+            flow result = runLoopBody(effects, &bodyEnd, _interpreter);
+            if (result != flow_next)
+            {
+                return result == flow_return ? flow_return : flow_next;
+            }
+        }
+        else // Condition is not true anymore
+        {
+            skipLoopBody(_interpreter->current, &bodyEnd, _interpreter);
+            // Need to remove variable from map
+            return flow_next;
+        }
+
+        insert_pair(variableName2, variableDataType2, _interpreter);
+
+        // Back to the condition, where a limit that runs out is reported
+        _interpreter->current = current;
+        countOps(_interpreter, 1);
+    }
+}
+
+// Most reductions a parallel for header may declare
+#define MAX_REDUCTIONS 8
+
+// Scalar combined across the workers of a parallel for, e.g. "reduction(+: total)"
+struct Reduction
+{
+    struct Slice name;
+    char op; // '+', '*', '<' for min, '>' for max
+};
+
+// Starting value of a reduction that leaves any other value unchanged
+static uint64_t reductionIdentity(char op)
+{
+    if (op == '*')
+    {
+        return 1;
+    }
+    else if (op == '<')
+    {
+        return UINT64_MAX;
+    }
+    return 0;
+}
+
+static uint64_t reduce(char op, uint64_t a, uint64_t b)
+{
+    if (op == '+')
+    {
+        return a + b;
+    }
+    else if (op == '*')
+    {
+        return a * b;
+    }
+    else if (op == '<')
+    {
+        return a < b ? a : b;
+    }
+    return a > b ? a : b;
+}
+
+// Block of iterations of a parallel for run by one thread in its own scope
+struct ParallelWorker
+{
+    pthread_t thread;
+    struct Interpreter *_interpreter; // Private scope of the worker
+    char const *body; // Just past the opening bracket of the loop body
+    struct Slice induction;
+    uint64_t first; // Value of the induction variable in the first iteration
+    uint64_t step;
+    uint64_t count; // Number of iterations
+    struct Reduction *reductions;
+    size_t numReductions;
+    uint64_t partial[MAX_REDUCTIONS]; // Value of each reduction over this block
+    size_t callDepth; // Calls in progress around the loop, they count toward the depth limit
+    struct Context *program; // Program the loop is part of
+    struct ParallelLoop *loop; // Shared with the workers of the loop, and of the loops nested in it
+    bool failed;
+    struct RunError error; // Why the worker failed
+    Queue woken; // Coroutines the worker woke, ready once the loop is done
+};
+
+// Drop what the body declared once an iteration is done, so the next iteration of the worker
+// can declare it again. Only the induction variable and the reductions are private before that.
+static void dropBodyLocals(struct ParallelWorker *worker)
+{
+    struct Interpreter *scope = worker->_interpreter;
+
+    for (size_t i = 0; i < scope->HASHMAP_CURR_SIZE; i++)
+    {
+        struct Pair *entry = scope->variables[i];
+        if (entry == NULL || entry->shared || operator2(entry->key, worker->induction))
+        {
+            continue;
+        }
+
+        bool reduction = false;
+        for (size_t r = 0; r < worker->numReductions; r++)
+        {
+            reduction |= operator2(entry->key, worker->reductions[r].name);
+        }
+        if (!reduction)
+        {
+            free((char *) entry->key.start);
+            release_value(&entry->value);
+            free(entry);
+            scope->variables[i] = NULL;
+        }
+    }
+}
+
+static void *runParallelWorker(void *arg)
+{
+    struct ParallelWorker *worker = arg;
+    struct Interpreter *_interpreter = worker->_interpreter;
+    bool wasParallel = inParallelRegion;
+    size_t wasDepth = callDepth;
+    struct Context *wasContext = context;
+    jmp_buf *outer = failTarget;
+    jmp_buf target;
+    uint64_t opened = openSerial;
+    Queue *wasWoken = wokenQ;
+    struct ParallelLoop *wasLoop = parallelLoop;
+    struct Interpreter *wasScope = runningScope;
+
+    inParallelRegion = true;
+    callDepth = worker->callDepth;
+    context = worker->program;
+    wokenQ = &worker->woken;
+    parallelLoop = worker->loop;
+
+    // An error can't unwind into another thread, the loop reports it once every worker is done
+    failTarget = &target;
+    if (setjmp(target) != 0)
+    {
+        release_open_since(opened, NULL);
+        // A worker that sleeps on a channel when the loop stops leaves without an error
+        worker->failed = lastError.kind != error_none;
+        worker->error = lastError;
+        lastError.report = NULL;
+        atomic_store(&worker->loop->stop, true);
+    }
+    else
+    {
+        for (uint64_t k = 0; k < worker->count && !atomic_load_explicit(&worker->loop->stop, memory_order_relaxed); k++)
+        {
+            struct data_type index = {integer, "\0", worker->first + k * worker->step, false};
+            insert_pair(worker->induction, index, _interpreter);
+
+            _interpreter->current = worker->body;
+            countOps(_interpreter, 1);
+
+            // The body has to run to its end, there is no function to return from and no loop to leave
+            if (statements(true, _interpreter) != flow_end)
+            {
+                fail(_interpreter);
+            }
+            dropBodyLocals(worker);
+        }
+
+        for (size_t r = 0; r < worker->numReductions; r++)
+        {
+            worker->partial[r] = get_value(worker->reductions[r].name, _interpreter).isInt;
+        }
+    }
+
+    // Workers that sleep on a channel may be waiting for this one. The worker of a nested loop
+    // is the worker of the enclosing one that got there, which is still running.
+    if (worker->loop != wasLoop)
+    {
+        pthread_mutex_lock(&worker->loop->lock);
+        worker->loop->running--;
+        pthread_mutex_unlock(&worker->loop->lock);
+        loopChanged(worker->loop);
+    }
+
+    failTarget = outer;
+    context = wasContext;
+    callDepth = wasDepth;
+    inParallelRegion = wasParallel;
+    wokenQ = wasWoken;
+    parallelLoop = wasLoop;
+    runningScope = wasScope;
+    return NULL;
+}
+
+// Give a worker its own copy of a variable that shadows any shared one
+static void insertPrivate(struct Slice key, struct data_type value, struct Interpreter *_interpreter)
+{
+    insert_pair(key, value, _interpreter);
+    get_pair(key, _interpreter)->shared = false;
+}
+
+// Give every array in scope its own elements
+static void unshareArrays(struct Interpreter *_interpreter)
+{
+    for (size_t i = 0; i < _interpreter->HASHMAP_CURR_SIZE; i++)
+    {
+        struct Pair *entry = _interpreter->variables[i];
+
+        if (entry != NULL && entry->value.curr_data_type == array)
+        {
+            array_make_unique(entry->value.isArray);
+        }
+    }
+}
+
+// parses "parallel for(integer i = a; i < b; i = i + c; reduction(+: x, max: y)) { ... }"
+// Iterations are split into contiguous blocks, one per core. Each worker has private copies of the
+// induction variable and the reductions, sees arrays and other variables as shared, and may only
+// write shared arrays; assigning a shared scalar fails. Not inlined into statement, see parseFor.
+__attribute__((noinline))
+static void parseParallelFor(bool effects, struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    if (!consume("integer", _interpreter))
+    {
+        fail(_interpreter);
+    }
+
+    struct optional_slice induction = consume_identifier(_interpreter);
+
+    if (!induction.present || !consume("=", _interpreter))
+    {
+        fail(_interpreter);
+    }
+
+    uint64_t first = expression(effects, _interpreter);
+
+    // i < bound or i <= bound, the bound is evaluated once
+    struct optional_slice condition = consume(";", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+
+    if (!condition.present || !operator2(condition.value, induction.value) || !consume("<", _interpreter))
+    {
+        fail(_interpreter);
+    }
+
+    bool inclusive = consume("=", _interpreter);
+    uint64_t bound = expression(effects, _interpreter);
+
+    // i = i + step
+    struct optional_slice update = consume(";", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+
+    if (!update.present || !operator2(update.value, induction.value) || !consume("=", _interpreter))
+    {
+        fail(_interpreter);
+    }
+
+    update = consume_identifier(_interpreter);
+    struct optional_int step = (update.present && operator2(update.value, induction.value) && consume("+", _interpreter)) ? consume_literal(_interpreter) : (struct optional_int) {false};
+
+    if (!step.present || step.value == 0)
+    {
+        fail(_interpreter);
+    }
+
+    // reduction(op: name, ...)
+    struct Reduction reductions[MAX_REDUCTIONS];
+    size_t numReductions = 0;
+
+    if (consume(";", _interpreter))
+    {
+        if (!consumeFunction("reduction", _interpreter))
+        {
+            fail(_interpreter);
+        }
+
+        do
+        {
+            struct Reduction *r = &reductions[numReductions];
+
+            if (consume("+", _interpreter))
+            {
+                r->op = '+';
+            }
+            else if (consume("*", _interpreter))
+            {
+                r->op = '*';
+            }
+            else if (consume("min", _interpreter))
+            {
+                r->op = '<';
+            }
+            else if (consume("max", _interpreter))
+            {
+                r->op = '>';
+            }
+            else
+            {
+                fail(_interpreter);
+            }
+
+            struct optional_slice name = consume(":", _interpreter) ? consume_identifier(_interpreter) : (struct optional_slice) {false};
+            struct data_type *value = name.present ? lookupVariable(name.value, _interpreter) : NULL;
+
+            // Partial results are combined with wrapping uint64_t arithmetic, so only plain integers qualify
+            if (numReductions == MAX_REDUCTIONS || value == NULL || value->curr_data_type != integer || value->numType != uint64)
+            {
+                fail(_interpreter);
+            }
+
+            r->name = name.value;
+            numReductions++;
+        } while (consume(",", _interpreter));
+
+        if (!consume(")", _interpreter))
+        {
+            fail(_interpreter);
+        }
+    }
+
+    if (!consume(")", _interpreter) || !consume("{", _interpreter))
+    {
+        fail(_interpreter);
+    }
+
+    char const *body = _interpreter->current;
+
+    // Number of iterations, rounding up for steps that overshoot the bound
+    uint64_t end = inclusive ? bound + 1 : bound;
+    uint64_t count = (inclusive && bound == UINT64_MAX) ? UINT64_MAX / step.value : 0;
+
+    if (count == 0 && end > first)
+    {
+        count = (end - first + step.value - 1) / step.value;
+    }
+
+    if (effects && count > 0)
+    {
+        // Nested parallel loops stay on the worker that reached them
+        uint64_t numWorkers = inParallelRegion ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+        if (numWorkers > count)
+        {
+            numWorkers = count;
+        }
+
+        // Workers write shared arrays in place, so none of them may still share its elements
+        if (!inParallelRegion)
+        {
+            unshareArrays(_interpreter);
+            unshareArrays(context->global);
+        }
+
+        struct ParallelWorker *workers = calloc(numWorkers, sizeof(struct ParallelWorker));
+        uint64_t next = 0;
+        struct ParallelLoop ownLoop = {false, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, numWorkers, 0, 0};
+        struct ParallelLoop *loop = inParallelRegion ? parallelLoop : &ownLoop;
+
+        for (uint64_t t = 0; t < numWorkers; t++)
+        {
+            struct ParallelWorker *worker = &workers[t];
+            uint64_t blockSize = count / numWorkers + (t < count % numWorkers ? 1 : 0);
+
+            worker->_interpreter = constructor1(_interpreter->program);
+            worker->_interpreter->braces = brace_table_retain(_interpreter->braces);
+            worker->_interpreter->origin = _interpreter->origin;
+            worker->_interpreter->caller = _interpreter;
+            worker->body = body;
+            worker->induction = induction.value;
+            worker->first = first + next * step.value;
+            worker->step = step.value;
+            worker->count = blockSize;
+            worker->reductions = reductions;
+            worker->numReductions = numReductions;
+            worker->callDepth = callDepth;
+            worker->program = context;
+            worker->loop = loop;
+            next += blockSize;
+
+            // Locals of the enclosing function are shared, globals are found through context->global
+            if (_interpreter != context->global)
+            {
+                for (size_t i = 0; i < _interpreter->HASHMAP_CURR_SIZE; i++)
+                {
+                    struct Pair *entry = _interpreter->variables[i];
+
+                    if (entry != NULL)
+                    {
+                        retain_value(&entry->value);
+                        insert_pair(entry->key, entry->value, worker->_interpreter);
+                        get_pair(entry->key, worker->_interpreter)->shared = true;
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < numReductions; r++)
+            {
+                struct data_type identity = {integer, "\0", reductionIdentity(reductions[r].op), false};
+                insertPrivate(reductions[r].name, identity, worker->_interpreter);
+            }
+
+            struct data_type index = {integer, "\0", worker->first, false};
+            insertPrivate(induction.value, index, worker->_interpreter);
+        }
+
+        if (numWorkers == 1)
+        {
+            runParallelWorker(&workers[0]);
+        }
+        else
+        {
+            for (uint64_t t = 0; t < numWorkers; t++)
+            {
+                if (pthread_create(&workers[t].thread, NULL, runParallelWorker, &workers[t]) != 0)
+                {
+                    perror("pthread_create");
+                    exit(1);
+                }
+            }
+
+            for (uint64_t t = 0; t < numWorkers; t++)
+            {
+                pthread_join(workers[t].thread, NULL);
+            }
+        }
+
+        // What the workers woke runs after the loop, in the order of the workers
+        for (uint64_t t = 0; t < numWorkers; t++)
+        {
+            wake_all(&workers[t].woken);
+        }
+
+        // Fold every worker's partial result into the variable the reduction names
+        for (size_t r = 0; r < numReductions; r++)
+        {
+            struct data_type *value = lookupVariable(reductions[r].name, _interpreter);
+
+            for (uint64_t t = 0; t < numWorkers; t++)
+            {
+                value->isInt = reduce(reductions[r].op, value->isInt, workers[t].partial[r]);
+            }
+        }
+
+        // The loop fails with the first error of a worker, once all of them are cleaned up
+        struct RunError error = {error_none, 0, 0, NULL};
+
+        for (uint64_t t = 0; t < numWorkers; t++)
+        {
+            if (workers[t].failed && error.kind == error_none)
+            {
+                error = workers[t].error;
+            }
+            else if (workers[t].failed)
+            {
+                free(workers[t].error.report);
+            }
+            free_interpreter(workers[t]._interpreter);
+        }
+        free(workers);
+        pthread_mutex_destroy(&ownLoop.lock);
+        pthread_cond_destroy(&ownLoop.changed);
+
+        if (error.kind != error_none)
+        {
+            raise_error(error);
+        }
+    }
+
+    // The induction variable ends where a sequential loop would have left it
+    struct data_type last = {integer, "\0", first + count * step.value, false};
+    checkPrivateWrite(induction.value, _interpreter);
+    insert_pair(induction.value, last, _interpreter);
+
+    _interpreter->current = body;
+    clearUntilClosingBracket(_interpreter);
+}
+
+// Run or skip the block of an if whose condition was evaluated, from just past its {, and then
+// the else after it if there is one
+static flow ifBlocks(bool effects, struct Interpreter *_interpreter, bool trueOrFalse)
+{
+    if (trueOrFalse) // If condition is true, run code inside if
+    {
+        // A return, break or continue leaves the rest, else included, to the function or loop
+        flow result = statements(effects, _interpreter);
+        if (result != flow_end)
+        {
+            return result;
+        }
+    }
+    else // Otherwise, skip through the code
+    {
+        clearUntilClosingBracket(_interpreter);
+    }
+
+    // If condition is false and there is else statement, run code inside else
+    if (consumeBracket("else", _interpreter))
+    {
+        if (!trueOrFalse)
+        {
+            flow result = statements(effects, _interpreter);
+            return result == flow_end ? flow_next : result;
+        }
+        else
+        {
+            clearUntilClosingBracket(_interpreter);
+        }
+    }
+    return flow_next;
+}
+
+static flow parseIfElse(bool effects, struct Interpreter *_interpreter)
+{
+    bool trueOrFalse = conditionHolds(effects, _interpreter, true); // Get boolean condition
+    return ifBlocks(effects, _interpreter, trueOrFalse);
+}
+
+// parses the data type of any initialized variable
+// Append len characters of s to the NUL terminated heap string being built in *ans
+static void appendString(char **ans, size_t *size, size_t *maxSize, char const *s, size_t len) {
+    if (*size + len + 1 > *maxSize) {
+        *maxSize = (*size + len + 1) * 2;
+        *ans = heap_resize(*ans, *maxSize);
+    }
+    memcpy(*ans + *size, s, len);
+    *size += len;
+    (*ans)[*size] = '\0';
+}
+
+// Parse a string made of "literals", string variables and string built-ins joined with +.
+// Any other term is evaluated as an integer and appended in decimal. The result is a new heap string.
+static char *parseString(bool effects, struct Interpreter *_interpreter) {
+    size_t maxSize = 16;
+    size_t i = 0;
+    char *ans = heap_alloc(maxSize, false, NULL);
+    ans[0] = '\0';
+    struct Held *held = hold_value(heap_release, ans, context->running);
+
+    while (true) {
+        held->object = ans; // Appending moves it
+        if (consume("\"", _interpreter)) {
+            char const *end = strchr(_interpreter->current, '\"');
+            if (end == NULL) {
+                fail(_interpreter);
+            }
+            appendString(&ans, &i, &maxSize, _interpreter->current, end - _interpreter->current);
+            _interpreter->current = end + 1;
+        } else {
+            char const *start = _interpreter->current;
+            struct optional_slice id = consume_identifier(_interpreter);
+            struct data_type *value = id.present ? lookupVariable(id.value, _interpreter) : NULL;
+            char *text = NULL;
+
+            if (value != NULL && value->curr_data_type == string) {
+                appendString(&ans, &i, &maxSize, value->ifString, strlen(value->ifString));
+            } else if (value != NULL && value->curr_data_type == view) {
+                appendString(&ans, &i, &maxSize, value->isView.text.start, value->isView.text.len);
+            } else {
+                size_t nameLength = id.present ? id.value.len : 0;
+                char name[nameLength + 1];
+                if (id.present) {
+                    memcpy(name, id.value.start, nameLength);
+                }
+                name[nameLength] = '\0';
+
+                if (id.present && !contains_function(name) && consume("(", _interpreter)) {
+                    text = runStringBuiltin(effects, _interpreter, name);
+                }
+
+                if (text != NULL) {
+                    appendString(&ans, &i, &maxSize, text, strlen(text));
+                    free(text);
+                } else {
+                    // Integer term, e1 also takes care of (expression)
+                    _interpreter->current = start;
+                    char num_str[48];
+                    int ndigits = number_format(num_str, sizeof(num_str), e1(effects, _interpreter));
+                    appendString(&ans, &i, &maxSize, num_str, ndigits);
+                }
+            }
+        }
+
+        if (!consume("+", _interpreter)) {
+            break;
+        }
+    }
+
+    let_go(held);
+    return ans;
+}
+
+static struct data_type parseDataType(struct Interpreter *_interpreter, struct optional_slice type, bool effects, variable_type currType) {
+    // checks for integer, boolean, or string keywords and returns the corressponding struct of their data type
+    number_kind kind = uint64;
+    bool sized = parseNumberKind(type.value, &kind);
+
+    if (sized || operator1("integer", type.value) || currType == integer) {
+        // Assigning keeps the kind the variable was declared with, a[i] = ... the element kind of a
+        struct data_type *current = sized || currType != integer || operator1("integer", type.value) ? NULL : lookupVariable(type.value, _interpreter);
+        if (current != NULL && current->curr_data_type == integer) {
+            kind = current->numType;
+        } else if (current != NULL && current->curr_data_type == array) {
+            kind = current->isArray->kind;
+        }
+
+        // Floats stored into an integer are truncated toward zero
+        uint64_t v;
+        if (!number_convert(typedExpression(effects, _interpreter), kind, &v)) {
+            fail(_interpreter);
+        }
+        struct data_type toReturn = {integer, '\0', v, false};
+        toReturn.numType = kind;
+        return toReturn;
+    } else if (operator1("boolean", type.value) || currType == boolean) {
+        uint64_t v = expression(effects, _interpreter);
+        struct data_type toReturn = {boolean, '\0', 0, (v == 1) ? true : false};
+        return toReturn;
+    } else if (operator1("string", type.value) || currType == string) {
+        struct data_type toReturn = {string, parseString(effects, _interpreter), 0, false};
+        return toReturn;
+    } else if (operator1("array", type.value) || currType == array) {
+        // array b = a shares the elements of a until either is written, array b = f(...) takes the array f returns
+        struct data_type toReturn = {array, '\0', 0, false};
+        struct optional_slice name = consume_identifier(_interpreter);
+
+        if (!name.present) {
+            fail(_interpreter);
+        }
+        char char_id[name.value.len + 1];
+        memcpy(char_id, name.value.start, name.value.len);
+        char_id[name.value.len] = '\0';
+
+        if (contains_function(char_id) && consume("(", _interpreter)) {
+            callFunction(effects, _interpreter, char_id, &toReturn.isArray);
+
+            if (toReturn.isArray == NULL) {
+                fail(_interpreter);
+            }
+            return toReturn;
+        }
+
+        struct data_type *source = lookupVariable(name.value, _interpreter);
+
+        if (source == NULL || source->curr_data_type != array) {
+            fail(_interpreter);
+        }
+        toReturn.isArray = array_share(source->isArray);
+        return toReturn;
+    } else if (operator1("view", type.value) || currType == view) {
+        // view v = mapFile(path) or another view, neither copies the text
+        struct data_type toReturn = {view, '\0', 0, false};
+
+        if (consume("mapFile", _interpreter)) {
+            if (!consume("(", _interpreter)) {
+                fail(_interpreter);
+            }
+            char *path = parseString(effects, _interpreter);
+            if (effects && !map_file(path, &toReturn.isView)) {
+                ioFail(_interpreter, path);
+            }
+            heap_release(path);
+            if (!consume(")", _interpreter)) {
+                fail(_interpreter);
+            }
+        } else {
+            toReturn.isView = consumeTyped(_interpreter, view)->isView;
+            heap_retain(toReturn.isView.file);
+        }
+        return toReturn;
+    } else if (operator1("map", type.value) || currType == map) {
+        // map b = a makes b another name for the map a, nothing is copied
+        struct data_type toReturn = {map, '\0', 0, false};
+        toReturn.isMap = consumeTyped(_interpreter, map)->isMap;
+        heap_retain(toReturn.isMap);
+        return toReturn;
+    } else if (operator1("thread", type.value) || currType == thread) {
+        // thread t = spawn f(...)
+        if (!consume("spawn ", _interpreter)) {
+            fail(_interpreter);
+        }
+
+        struct data_type toReturn = {thread, '\0', 0, false};
+        toReturn.isThread = spawnFunction(effects, _interpreter);
+        heap_retain(toReturn.isThread);
+        return toReturn;
+    }
+
+    fail(_interpreter);
+}
+
+// Words that start a statement other than an assignment, or give a name = ... a type
+static char const *const statementWords[] = {"print", "if", "while", "for", "spawn", "parallel", "fun", "memo", "return", "break",
+                                      "continue", "view", "thread", "channel", NULL};
+
+// Work out whether the statement at offset of program assigns to an untyped name, name = value,
+// and fill in *assignment if it does. name = name + constant or name - constant is a step.
+static bool parseAssignment(char const *program, size_t offset, struct Assignment *assignment)
+{
+    char const *p = program + offset;
+    if (!isalpha(*p))
+    {
+        return false;
+    }
+    do
+    {
+        p++;
+    } while (isalnum(*p));
+    struct Slice name = new_slice1(program + offset, p - (program + offset));
+    if (isTypeName(name) || inWordList(statementWords, name))
+    {
+        return false;
+    }
+
+    while (isspace(*p))
+    {
+        p++;
+    }
+    if (p[0] != '=' || p[1] == '=')
+    {
+        return false;
+    }
+
+    *assignment = (struct Assignment) {offset, name.len, p + 1 - program, 0, 0};
+
+    struct SimpleExpression value;
+    if (parseSimpleExpression(program, assignment->value, &value) && (value.op == '+' || value.op == '-') &&
+        value.left.kind == expr_variable && value.right.kind == expr_literal && value.left.nameLength == name.len &&
+        memcmp(program + value.left.name, name.start, name.len) == 0)
+    {
+        assignment->step = value.op == '+' ? value.right.value : -value.right.value;
+        assignment->end = value.end;
+    }
+    return true;
+}
+
+// Work out whether the statement at offset of program is an if with a simple condition, and fill
+// in *branch if it is
+static bool parseIfBranch(char const *program, size_t offset, struct Branch *branch)
+{
+    char const *p = program + offset;
+    if (p[0] != 'i' || p[1] != 'f')
+    {
+        return false;
+    }
+    p += 2;
+    while (isspace(*p))
+    {
+        p++;
+    }
+    return *p == '(' && parseBranch(program, p + 1 - program, branch);
+}
+
+// Run the statement at the current position if its site was worked out, see fuseNow, without
+// parsing it. An assignment to an integer variable stores without parsing the name again or
+// looking up its scope more than needed, a step of a plain integer is added in place. An if with
+// a simple condition compares its operands and goes straight to its block, *result is how the
+// if finished. False leaves the statement to the generic parser.
+static bool fusedStatement(struct Interpreter *_interpreter, flow *result)
+{
+    skip(_interpreter);
+    struct FastSite *site = fastSite(_interpreter);
+    if (site != NULL && fuseNow(site))
+    {
+        if (parseAssignment(_interpreter->program, site->offset, &site->assignment))
+        {
+            site->kind = site_assignment;
+        }
+        else
+        {
+            site->kind = parseIfBranch(_interpreter->program, site->offset, &site->branch) ? site_branch : site_generic;
+        }
+    }
+
+    bool holds;
+    if (site != NULL && site->kind == site_branch && simpleCondition(_interpreter, &site->branch.condition, &holds))
+    {
+        _interpreter->current = _interpreter->program + site->branch.body;
+        *result = ifBlocks(true, _interpreter, holds);
+        return true;
+    }
+    if (site == NULL || site->kind != site_assignment)
+    {
+        return false;
+    }
+
+    *result = flow_next;
+    struct Assignment const *assignment = &site->assignment;
+    struct Slice name = new_slice1(_interpreter->program + assignment->name, assignment->nameLength);
+    struct data_type *stored = lookupVariable(name, _interpreter);
+    if (stored == NULL || stored->curr_data_type != integer)
+    {
+        return false;
+    }
+
+    _interpreter->current = _interpreter->program + assignment->value;
+    checkPrivateWrite(name, _interpreter);
+
+    if (assignment->end != 0 && stored->numType == uint64)
+    {
+        stored->isInt += assignment->step;
+        _interpreter->current = _interpreter->program + assignment->end;
+        return true;
+    }
+
+    // The value may run code that moves the variable, it is looked up again to store it
+    number_kind kind = stored->numType;
+    uint64_t v;
+    if (!number_convert(typedExpression(true, _interpreter), kind, &v))
+    {
+        fail(_interpreter);
+    }
+    stored = lookupVariable(name, _interpreter);
+    if (stored == NULL || stored->curr_data_type != integer)
+    {
+        fail(_interpreter);
+    }
+    stored->isInt = v;
+    return true;
+}
+
+// Run one statement, at the top level as well as in the body of a function, loop or if
+static flow statement(bool effects, struct Interpreter *_interpreter)
+{
+    runningScope = _interpreter;
+    flow fused;
+    if (effects && fusedStatement(_interpreter, &fused))
+    {
+        return fused;
+    }
+    skip(_interpreter);
+    char const *start = _interpreter->current; // Where the statement starts
+
+    // Check for print statements
+    if (consumeFunction("print", _interpreter))
+    {
+        // print ...
+        if (effects)
+        {
+            printString(effects, _interpreter);
+            //printf("%lu\n", expression(effects, _interpreter));
+        }
+
+        consume(")", _interpreter);
+        return flow_next;
+    }
+    else if (consumeFunction("if", _interpreter))
+    {
+        // if (...       )
+        return parseIfElse(effects, _interpreter);
+    }
+    else if (consumeFunction("while", _interpreter))
+    {
+	// while (...    )
+        return parseWhile(effects, _interpreter);
+    }
+    else if (consumeFunction("for", _interpreter))
+    {
+        return parseFor(effects, _interpreter, start);
+    }
+    else if (consume("spawn ", _interpreter))
+    {
+        // spawn <FUNCTION_NAME>(...)
+        spawnFunction(effects, _interpreter);
+        return flow_next;
+    }
+    else if (consume("parallel ", _interpreter))
+    {
+        // parallel for (...   )
+        if (!consumeFunction("for", _interpreter))
+        {
+            fail(_interpreter);
+        }
+        parseParallelFor(effects, _interpreter);
+        return flow_next;
+    }
+    else if (consume("fun ", _interpreter))
+    {
+	// fun <FUNCTION_NAME>(..., , )
+        if (inParallelRegion)
+        {
+            fail(_interpreter);
+        }
+        if (effects)
+        {
+            parseFunction(effects, _interpreter, false);
+        }
+        return flow_next;
+    }
+    else if (consumeMemoFun(_interpreter))
+    {
+        // memo fun <FUNCTION_NAME>(..., , )
+        if (inParallelRegion)
+        {
+            fail(_interpreter);
+        }
+        if (effects)
+        {
+            parseFunction(effects, _interpreter, true);
+        }
+        return flow_next;
+    }
+    else if (consume("return ", _interpreter))
+    {
+	// return <EXPRESSION>, at the top level it ends the program
+        returnValue = 0;
+        if (!returnArray(effects, _interpreter, &returnValue))
+        {
+            struct number result = typedExpression(effects, _interpreter);
+            returnValue = result.value;
+            resultKind = number_kind_of(result);
+        }
+        return flow_return;
+    }
+    else if (consumeKeyword("break", _interpreter))
+    {
+        return flow_break;
+    }
+    else if (consumeKeyword("continue", _interpreter))
+    {
+        return flow_continue;
+    }
+    else if (consume("}", _interpreter))
+    {
+	// Check for closing bracket
+        return flow_end;
+    }
+
+    struct optional_slice testid = consume_identifier(_interpreter);
+
+    if (testid.present)
+    {
+        struct Slice id = testid.value;
+
+        if (consume("(", _interpreter))
+        {
+            char const *function;
+            struct Function *func = resolveCall(_interpreter, id, &function);
+            if (func != NULL)
+            {
+                callResolved(effects, _interpreter, function, func, NULL);
+                return flow_next;
+            }
+
+            char char_id[id.len + 1];
+            memcpy(char_id, id.start, id.len);
+            char_id[id.len] = '\0';
+            uint64_t val;
+            bool builtin = runBuiltin(effects, _interpreter, char_id, &val);
+            if (!builtin)
+            {
+                fail(_interpreter);
+            }
+            return flow_next;
+        }
+
+        struct optional_slice name = consume_identifier(_interpreter);
+        bool isElement = false; // a[arrayIndex] = ...
+        size_t arrayIndex = 0;
+        struct Map *mapTarget = NULL; // Set with mapKey for m[key] = ...
+        struct MapKey mapKey;
+
+        if (!name.present) {
+            if (consume("[", _interpreter)) {
+                struct data_type *stored = lookupVariable(id, _interpreter);
+
+                if (stored != NULL && stored->curr_data_type == map) {
+                    mapTarget = stored->isMap;
+                    mapKey = parseMapKey(effects, _interpreter);
+                } else {
+                    arrayIndex = expression(effects, _interpreter);
+                    isElement = true;
+                }
+                consume("]", _interpreter);
+            }
+        } else {
+            id = name.value;
+        }
+
+        // x = ...
+        if (consume("=", _interpreter)) // Check if we are setting variable equal to an expression
+        {
+            if (effects)
+            {
+                if (mapTarget != NULL) {
+                    checkPrivateWrite(id, _interpreter);
+                    map_put(mapTarget, mapKey, integerExpression(effects, _interpreter));
+                } else if (isElement) {
+
+                    // Determine global vs local scope
+                    
+                    if (contains(id, _interpreter))
+                    {
+                        struct data_type value = parseDataType(_interpreter, testid, effects, integer);
+                        if (!insert_into_array(id, value, _interpreter, arrayIndex))
+                        {
+                            elementFail(_interpreter, id, arrayIndex);
+                        }
+                    }
+                    else if (contains(id, context->global))
+                    {
+                        struct data_type value = parseDataType(_interpreter, testid, effects, integer);
+                        if (!insert_into_array(id, value, context->global, arrayIndex))
+                        {
+                            elementFail(_interpreter, id, arrayIndex);
+                        }
+                    }
+                    else
+                    {
+                        fail(_interpreter);
+                    }
+                } else {
+                    checkPrivateWrite(id, _interpreter);
+
+                    // Determine global vs local scope
+                    if (contains(id, _interpreter))
+                    {
+                        struct data_type value = parseDataType(_interpreter, testid, effects, get_value(id, _interpreter).curr_data_type);
+                        insert_pair(id, value, _interpreter);
+                    }
+                    else if (contains(id, context->global))
+                    {
+                        struct data_type value = parseDataType(_interpreter, testid, effects, get_value(id, context->global).curr_data_type);
+                        insert_pair(id, value, context->global);
+                    }
+                    else
+                    {
+                        struct data_type value = parseDataType(_interpreter, testid, effects, empty);
+                        insert_pair(id, value, _interpreter);
+                    }
+                }
+            }
+            else if (mapTarget != NULL)
+            {
+                map_drop_key(mapKey);
+            }
+            return flow_next;
+        }
+
+        // We have found an array
+        else if (consume("[", _interpreter)) 
+        {
+            if (effects) 
+            {
+                uint64_t arraySize = expression(effects, _interpreter);
+
+                if (!consume("]", _interpreter)) {
+                    fail(_interpreter);
+                }
+
+                struct data_type toReturn;
+
+                // channel c[capacity]
+                if (operator1("channel", testid.value))
+                {
+                    if (arraySize == 0)
+                    {
+                        fail(_interpreter);
+                    }
+                    toReturn.curr_data_type = channel;
+                    toReturn.isChannel = new_channel(arraySize);
+                }
+                // map m[capacity], capacity is only a hint and 0 is fine
+                else if (operator1("map", testid.value))
+                {
+                    toReturn.curr_data_type = map;
+                    toReturn.isMap = new_map(arraySize);
+                }
+                else
+                {
+                    // integer a[n], or a packed array of one of the sized types
+                    number_kind kind = uint64;
+                    parseNumberKind(testid.value, &kind);
+                    toReturn.curr_data_type = array;
+                    toReturn.isArray = new_array(arraySize, kind);
+                }
+
+                if (contains(id, _interpreter)) {
+                    fail(_interpreter);
+                }
+
+                insert_pair(id, toReturn, _interpreter);
+            }   
+
+            return flow_next;
+        }
+
+	    // We have found a function instead and not a variable assignment
+        else
+        {
+            fail(_interpreter);
+        }
+    }
+    return flow_end;
+}
+
+// Run the statements of a block until it ends or one of them returns, and tell which it was
+static flow statements(bool effects, struct Interpreter *_interpreter)
+{
+    // Run program line by line
+    flow result;
+    while ((result = statement(effects, _interpreter)) == flow_next)
+        ;
+    return result;
+}
+
+// Run program, false once a return at the top level ended it
+static bool run(struct Interpreter *_interpreter)
+{
+    flow result = statements(true, _interpreter);
+    if (result == flow_return)
+    {
+        return false;
+    }
+    if (result != flow_end)
+    {
+        // break or continue outside a loop
+        fail(_interpreter);
+    }
+    end_or_fail(_interpreter);
+    return true;
+}
+
+// Call body(_interpreter, arg), but an error or a limit that ran out comes back in *error and
+// false is returned instead of the process ending. Otherwise *result is what body returned.
+static bool runGuarded(bool (*body)(struct Interpreter *, void *), struct Interpreter *_interpreter, void *arg, bool *result, struct RunError *error)
+{
+    jmp_buf target;
+    jmp_buf *outer = failTarget;
+    struct Interpreter *wasRunning = context->running;
+    size_t depth = callDepth;
+    uint64_t opened = openSerial;
+    struct Interpreter *wasScope = runningScope;
+
+    runningScope = NULL;
+    failTarget = &target;
+    if (setjmp(target) != 0)
+    {
+        // The frames the failed run had open are freed with what they hold. A coroutine that
+        // failed is dropped with all of its frames, the others sleep on untouched. The run
+        // itself may have been asleep waiting for it, it carries on from here instead.
+        failTarget = outer;
+        struct Interpreter *failed = context->running;
+        context->running = wasRunning;
+        release_open_since(opened, wasRunning);
+        if (failed != wasRunning && failed != context->global)
+        {
+            unlinkQ(wasRunning);
+            release_open_since(0, failed);
+            abandon_coroutine(failed);
+        }
+        callDepth = depth;
+        runningScope = wasScope;
+        heap_release(returnedArray);
+        returnedArray = NULL;
+
+        *error = lastError;
+        lastError.report = NULL;
+        return false;
+    }
+
+    *result = body(_interpreter, arg);
+    failTarget = outer;
+    runningScope = wasScope;
+    return true;
+}
+
+static bool runBody(struct Interpreter *_interpreter, void *arg)
+{
+    (void) arg;
+    return run(_interpreter);
+}
+
+// Run program like run, but an error or a limit that ran out comes back in *error instead of ending
+// the process. *more is false once a return at the top level ended the program.
+static bool runChecked(struct Interpreter *_interpreter, bool *more, struct RunError *error)
+{
+    return runGuarded(runBody, _interpreter, NULL, more, error);
+}
+
+// New program called name in its source locations, with an empty global scope. It becomes the
+// context of this thread.
+static struct Context *new_context(char const *name)
+{
+    context = calloc(1, sizeof(struct Context));
+    context->heap.limit = SIZE_MAX;
+    source_init(&context->source, name);
+    init_function_table();
+
+    // The global scope runs as the first coroutine
+    context->global = constructor1("");
+    init_scheduler(context->global);
+    init_event_loop();
+
+    return context;
+}
+
+// Brace table of the length bytes of program, which start at origin in the source. With --profile
+// the context keeps it, so what ran in it can still be reported once the program ended, and with
+// --profile-guided so its sites can be ranked. A streamed program keeps it until the source map
+// no longer needs its lines.
+static struct BraceTable *programBraces(char const *program, size_t length, size_t origin)
+{
+    struct BraceTable *table = new_brace_table(program, length);
+    if (table == NULL)
+    {
+        return NULL;
+    }
+    table->origin = origin;
+    if (context->profiling || context->guided)
+    {
+        context->profiled = realloc(context->profiled, (context->profiledCount + 1) * sizeof(struct BraceTable *));
+        context->profiled[context->profiledCount++] = brace_table_retain(table);
+    }
+    if (context->streaming)
+    {
+        context->streamed = realloc(context->streamed, (context->streamedCount + 1) * sizeof(struct BraceTable *));
+        context->streamed[context->streamedCount++] = brace_table_retain(table);
+    }
+    return table;
+}
+
+// Most sites --profile reports
+#define PROFILE_SITES 20
+
+// Site of a kept brace table and where it is in the source
+struct ProfiledSite
+{
+    struct FastSite *site;
+    size_t offset;
+};
+
+// Most runs first
+static int compareRuns(void const *a, void const *b)
+{
+    uint64_t x = ((struct ProfiledSite const *) a)->site->runs;
+    uint64_t y = ((struct ProfiledSite const *) b)->site->runs;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Every site of the kept brace tables, the one that ran most first. Sets *count to how many.
+static struct ProfiledSite *profiledSites(size_t *count)
+{
+    *count = 0;
+    for (size_t i = 0; i < context->profiledCount; i++)
+    {
+        *count += context->profiled[i]->fastCount;
+    }
+
+    struct ProfiledSite *sites = malloc((*count + 1) * sizeof(struct ProfiledSite));
+    *count = 0;
+    for (size_t i = 0; i < context->profiledCount; i++)
+    {
+        struct BraceTable const *table = context->profiled[i];
+        for (size_t j = 0; j < table->fastCount; j++)
+        {
+            struct FastSite *site = brace_fast_site_at(table, j);
+            sites[(*count)++] = (struct ProfiledSite) {site, table->origin + site->offset};
+        }
+    }
+    qsort(sites, *count, sizeof(struct ProfiledSite), compareRuns);
+    return sites;
+}
+
+// Pick the sites to fuse for --profile-guided: those that ran most, until they make up
+// FUSE_SHARE percent of all the runs so far. Each is worked out the next time it runs.
+static void rankSites()
+{
+    size_t count;
+    struct ProfiledSite *sites = profiledSites(&count);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total += sites[i].site->runs;
+    }
+
+    uint64_t picked = 0;
+    for (size_t i = 0; i < count && picked * 100 < total * FUSE_SHARE && sites[i].site->runs >= FUSE_AFTER; i++)
+    {
+        sites[i].site->hot = true;
+        picked += sites[i].site->runs;
+    }
+    free(sites);
+
+    context->nextRanking = context->siteRuns + (16 * count > FUSE_WARMUP ? 16 * count : FUSE_WARMUP);
+}
+
+// The statements and expressions that ran most, how often and how they run now, for --profile.
+// Runs of parallel workers aren't counted.
+__attribute__((unused))
+static void print_profile()
+{
+    size_t count;
+    struct ProfiledSite *sites = profiledSites(&count);
+
+    for (size_t i = 0; i < count && i < PROFILE_SITES; i++)
+    {
+        fprintf(stderr, "profile ");
+        source_print_location(&context->source, stderr, sites[i].offset);
+        fprintf(stderr, ": %lu runs, %s\n", sites[i].site->runs, site_kind_names[sites[i].site->kind]);
+    }
+
+    free(sites);
+}
+
+// Release a program that no longer runs, coroutines it left suspended are dropped with it
+__attribute__((unused))
+static void free_context(struct Context *program)
+{
+    struct Context *wasContext = context;
+    context = program;
+
+    close_scheduler(program->global);
+    free_interpreter(program->global);
+    free_function_table();
+    source_free(&program->source);
+    for (size_t i = 0; i < program->profiledCount; i++)
+    {
+        brace_table_release(program->profiled[i]);
+    }
+    free(program->profiled);
+    for (size_t i = 0; i < program->streamedCount; i++)
+    {
+        brace_table_release(program->streamed[i]);
+    }
+    free(program->streamed);
+    free(program);
+
+    context = wasContext != program ? wasContext : NULL;
+}
+
+// Function used for edge cases w/ calling functions, checks if paren is placed after "fun"
+static bool consumeFunction(const char *str, struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    char const *current = _interpreter->current;
+
+    size_t i = 0;
+    while (true)
+    {
+        char const expected = str[i];
+        char const found = current[i];
+
+        if (expected == 0)
+        {
+            /* survived to the end of the expected string */
+            current += i;
+            _interpreter->current = current;
+
+	    // If we have found the paren, exit
+            if (consume("(", _interpreter))
+            {
+                return true;
+            }
+            else
+            {
+                current -= i;
+                _interpreter->current = current;
+                return false;
+            }
+        }
+        if (expected != found)
+        {
+            return false;
+        }
+        // assertion: found != 0
+        i += 1;
+    }
+}
+
+// Function used for edge cases w/ if/else and while statements, checks if bracket is placed after if/else and while calls
+static bool consumeBracket(const char *str, struct Interpreter *_interpreter)
+{
+    skip(_interpreter);
+
+    char const *current = _interpreter->current;
+
+    size_t i = 0;
+    while (true)
+    {
+        char const expected = str[i];
+        char const found = current[i];
+
+        if (expected == 0)
+        {
+            /* survived to the end of the expected string */
+            current += i;
+            _interpreter->current = current;
+
+	    // If we have reached the bracket, return
+            if (consume("{", _interpreter))
+            {
+                return true;
+            }
+            else
+            {
+                current -= i;
+                _interpreter->current = current;
+                return false;
+            }
+        }
+        if (expected != found)
+        {
+            return false;
+        }
+        // assertion: found != 0
+        i += 1;
+    }
+}
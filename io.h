@@ -0,0 +1,375 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "coroutine.h"
+
+// I/O for the built-ins. With async set the calling coroutine suspends instead of
+// blocking the thread: pipes and sockets wait in the scheduler's epoll loop, regular
+// files (which epoll can't watch) go to a small pool of helper threads. Parallel for
+// workers aren't coroutines and pass async = false to do plain blocking I/O.
+
+#define IO_THREADS 4
+
+typedef enum {job_read, job_write} job_kind;
+
+// File operation handed to a helper thread
+struct IoJob
+{
+    job_kind kind;
+    char const *path;
+    char *data; // Contents read, or to write
+    size_t length;
+    int error; // errno of the failed call, 0 on success
+    struct Interpreter *waiter;
+    struct Context *owner; // Program of waiter
+    struct IoJob *next;
+};
+
+static struct IoJob *jobs; // Submitted and not picked up yet
+static pthread_mutex_t jobsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobsReady = PTHREAD_COND_INITIALIZER;
+static bool ioThreadsStarted = false;
+
+// Read a whole file into a NUL terminated buffer
+static char *read_whole_file(char const *path, size_t *length, int *error)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = errno;
+        return NULL;
+    }
+
+    struct stat file_stats;
+    size_t capacity = fstat(fd, &file_stats) == 0 && file_stats.st_size > 0 ? file_stats.st_size + 1 : 4096;
+    char *data = malloc(capacity);
+    size_t used = 0;
+
+    while (true) {
+        if (used + 1 >= capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+        ssize_t n = read(fd, data + used, capacity - used - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            *error = errno;
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += n;
+    }
+
+    close(fd);
+    data[used] = '\0';
+    *length = used;
+    return data;
+}
+
+static bool write_whole_file(char const *path, char const *data, size_t length, int *error)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        *error = errno;
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            *error = errno;
+            close(fd);
+            return false;
+        }
+        done += n;
+    }
+
+    if (close(fd) < 0) {
+        *error = errno;
+        return false;
+    }
+    return true;
+}
+
+static void run_job(struct IoJob *job)
+{
+    if (job->kind == job_read) {
+        job->data = read_whole_file(job->path, &job->length, &job->error);
+    } else {
+        write_whole_file(job->path, job->data, job->length, &job->error);
+    }
+}
+
+static void *io_thread(void *arg)
+{
+    (void) arg;
+    while (true) {
+        pthread_mutex_lock(&jobsLock);
+        while (jobs == NULL) {
+            pthread_cond_wait(&jobsReady, &jobsLock);
+        }
+        struct IoJob *job = jobs;
+        jobs = job->next;
+        pthread_mutex_unlock(&jobsLock);
+
+        run_job(job);
+        complete_io(job->owner, job->waiter);
+    }
+    return NULL;
+}
+
+// Run job, on a helper thread if async, and return once it has finished
+static void submit_job(struct IoJob *job, bool async)
+{
+    if (!async) {
+        run_job(job);
+        return;
+    }
+
+    pthread_mutex_lock(&jobsLock);
+    if (!ioThreadsStarted) {
+        for (int i = 0; i < IO_THREADS; i++) {
+            pthread_t id;
+            pthread_create(&id, NULL, io_thread, NULL);
+            pthread_detach(id);
+        }
+        ioThreadsStarted = true;
+    }
+    job->waiter = context->running;
+    job->owner = context;
+    job->next = jobs;
+    jobs = job;
+    pthread_cond_signal(&jobsReady);
+    pthread_mutex_unlock(&jobsLock);
+
+    wait_job();
+}
+
+// Wait until fd can be read or written without blocking the thread
+static void wait_ready(int fd, short events, bool async)
+{
+    struct pollfd p = {fd, events, 0};
+    if (!async) {
+        poll(&p, 1, -1);
+    } else if (poll(&p, 1, 0) == 0 && !wait_fd(fd, events == POLLIN ? EPOLLIN : EPOLLOUT)) {
+        // Another coroutine is already waiting on fd, retry after the others ran
+        yield_coroutine();
+    }
+}
+
+// Input already read from an fd but not yet returned as a line
+struct LineBuffer
+{
+    char *data;
+    size_t start; // First byte not returned yet
+    size_t length; // End of the bytes read
+    size_t capacity;
+    bool eof; // Last read_line found nothing left
+};
+
+static struct LineBuffer **lineBuffers; // Indexed by fd
+static size_t numLineBuffers = 0;
+static pthread_mutex_t lineBuffersLock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct LineBuffer *line_buffer(int fd)
+{
+    pthread_mutex_lock(&lineBuffersLock);
+    if ((size_t) fd >= numLineBuffers) {
+        size_t n = fd * 2 + 8;
+        lineBuffers = realloc(lineBuffers, n * sizeof(struct LineBuffer *));
+        memset(lineBuffers + numLineBuffers, 0, (n - numLineBuffers) * sizeof(struct LineBuffer *));
+        numLineBuffers = n;
+    }
+    if (lineBuffers[fd] == NULL) {
+        lineBuffers[fd] = calloc(1, sizeof(struct LineBuffer));
+    }
+    struct LineBuffer *buffer = lineBuffers[fd];
+    pthread_mutex_unlock(&lineBuffersLock);
+    return buffer;
+}
+
+// Returns the next line of fd without its newline, or the rest of the input
+// at end of file. NULL with errno set if the read failed.
+static char *read_line(int fd, bool async)
+{
+    struct LineBuffer *buffer = line_buffer(fd);
+    buffer->eof = false;
+
+    size_t scanned = buffer->start;
+    while (true) {
+        char *newline = scanned < buffer->length ? memchr(buffer->data + scanned, '\n', buffer->length - scanned) : NULL;
+        if (newline != NULL) {
+            size_t n = newline - (buffer->data + buffer->start);
+            char *line = strndup(buffer->data + buffer->start, n);
+            buffer->start += n + 1;
+            return line;
+        }
+        scanned = buffer->length;
+
+        // Slide the unreturned bytes to the front before reading more
+        if (buffer->start > 0) {
+            memmove(buffer->data, buffer->data + buffer->start, buffer->length - buffer->start);
+            buffer->length -= buffer->start;
+            scanned -= buffer->start;
+            buffer->start = 0;
+        }
+        if (buffer->length == buffer->capacity) {
+            buffer->capacity = buffer->capacity * 2 + 4096;
+            buffer->data = realloc(buffer->data, buffer->capacity);
+        }
+
+        wait_ready(fd, POLLIN, async);
+        ssize_t n = read(fd, buffer->data + buffer->length, buffer->capacity - buffer->length);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n < 0) {
+            return NULL;
+        }
+        if (n == 0) {
+            buffer->eof = buffer->length == 0;
+            char *line = strndup(buffer->data, buffer->length);
+            buffer->length = 0;
+            return line;
+        }
+        buffer->length += n;
+    }
+}
+
+// Write all of data, false with errno set on failure
+static bool write_all(int fd, char const *data, size_t length, bool async)
+{
+    size_t done = 0;
+    while (done < length) {
+        wait_ready(fd, POLLOUT, async);
+        ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static bool fill_address(struct sockaddr_un *address, char const *path)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// Listening Unix domain socket at path, -1 with errno set on failure.
+// A socket file left behind by an earlier run is replaced.
+static int listen_unix(char const *path)
+{
+    struct sockaddr_un address;
+    if (!fill_address(&address, path)) {
+        return -1;
+    }
+
+    struct stat file_stats;
+    if (stat(path, &file_stats) == 0 && S_ISSOCK(file_stats.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static int accept_unix(int fd, bool async)
+{
+    while (true) {
+        wait_ready(fd, POLLIN, async);
+        int client = accept(fd, NULL, NULL);
+        if (client >= 0) {
+            fcntl(client, F_SETFL, O_NONBLOCK);
+            fcntl(client, F_SETFD, FD_CLOEXEC);
+            return client;
+        }
+        if (errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static int connect_unix(char const *path, bool async)
+{
+    struct sockaddr_un address;
+    if (!fill_address(&address, path)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // A full backlog makes a nonblocking Unix connect fail with EAGAIN, retry once it drains
+    while (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        if (async) {
+            yield_coroutine();
+        }
+    }
+    return fd;
+}
+
+// Close fd and drop any input buffered for it
+static int close_fd(int fd)
+{
+    pthread_mutex_lock(&lineBuffersLock);
+    if ((size_t) fd < numLineBuffers && lineBuffers[fd] != NULL) {
+        free(lineBuffers[fd]->data);
+        free(lineBuffers[fd]);
+        lineBuffers[fd] = NULL;
+    }
+    pthread_mutex_unlock(&lineBuffersLock);
+    return close(fd);
+}
+
+static bool at_eof(int fd)
+{
+    return line_buffer(fd)->eof;
+}
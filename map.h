@@ -0,0 +1,308 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "heap.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Open addressing hash table behind map variables. Next to the slots sits one control byte
+// per slot: empty, deleted, or the low 7 bits of the hash of the key stored there. Slots are
+// probed in aligned groups of 16 and a whole group of control bytes is compared against the
+// hash at once with SSE2, so a lookup only looks at keys whose 7 bits already match and most
+// misses end in the first group without touching a slot.
+
+#define MAP_GROUP 16 // Control bytes compared at once
+#define MAP_EMPTY 0x80
+#define MAP_DELETED 0xFE
+
+// text is a heap string for string keys, number then caches its hash. Integer keys have no text.
+struct MapKey
+{
+    uint64_t number;
+    char *text;
+};
+
+struct MapSlot
+{
+    struct MapKey key;
+    uint64_t value;
+};
+
+struct Map
+{
+    size_t size; // Keys stored
+    size_t used; // Slots that aren't empty, deleted ones included
+    size_t capacity; // Slots, 0 or a power of 2 of at least MAP_GROUP
+    uint8_t *control;
+    struct MapSlot *slots;
+};
+
+static uint64_t map_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static struct MapKey map_int_key(uint64_t number)
+{
+    struct MapKey key = {number, NULL};
+    return key;
+}
+
+// Key for a heap string, taking over the caller's reference to text
+static struct MapKey map_string_key(char *text)
+{
+    // FNV-1a, spread over all bits by map_mix
+    uint64_t h = 14695981039346656037ULL;
+    for (char const *p = text; *p; p++) {
+        h = (h ^ (uint8_t) *p) * 1099511628211ULL;
+    }
+    struct MapKey key = {h, text};
+    return key;
+}
+
+static uint64_t map_hash(struct MapKey key)
+{
+    return map_mix(key.text == NULL ? key.number : ~key.number);
+}
+
+static bool map_key_equal(struct MapKey a, struct MapKey b)
+{
+    if (a.number != b.number || (a.text == NULL) != (b.text == NULL)) {
+        return false;
+    }
+    return a.text == NULL || a.text == b.text || strcmp(a.text, b.text) == 0;
+}
+
+static void map_drop_key(struct MapKey key)
+{
+    heap_release(key.text);
+}
+
+// Bit i set where control byte i of the group is byte
+static unsigned map_match(uint8_t const *group, uint8_t byte)
+{
+#if defined(__SSE2__)
+    __m128i control = _mm_load_si128((__m128i const *) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char) byte)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < MAP_GROUP; i++) {
+        mask |= (unsigned) (group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i set where slot i of the group is empty or deleted, both have their high bit set
+static unsigned map_match_free(uint8_t const *group)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_load_si128((__m128i const *) group));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < MAP_GROUP; i++) {
+        mask |= (unsigned) (group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+// Slot holding key, -1 if it isn't in the map
+static ptrdiff_t map_find(struct Map const *m, struct MapKey key, uint64_t hash)
+{
+    if (m->capacity == 0) {
+        return -1;
+    }
+
+    // Triangular steps over a power of 2 of groups reach every group once
+    size_t groups = m->capacity / MAP_GROUP;
+    size_t g = (hash >> 7) & (groups - 1);
+    for (size_t step = 1; ; step++) {
+        uint8_t const *group = m->control + g * MAP_GROUP;
+        for (unsigned match = map_match(group, hash & 0x7F); match != 0; match &= match - 1) {
+            size_t i = g * MAP_GROUP + __builtin_ctz(match);
+            if (map_key_equal(m->slots[i].key, key)) {
+                return i;
+            }
+        }
+        // Keys are only placed past a group that had no free slot, so an empty one ends the search
+        if (map_match(group, MAP_EMPTY) != 0) {
+            return -1;
+        }
+        g = (g + step) & (groups - 1);
+    }
+}
+
+// First empty or deleted slot on the probe sequence of hash
+static size_t map_find_free(struct Map const *m, uint64_t hash)
+{
+    size_t groups = m->capacity / MAP_GROUP;
+    size_t g = (hash >> 7) & (groups - 1);
+    for (size_t step = 1; ; step++) {
+        unsigned free_slots = map_match_free(m->control + g * MAP_GROUP);
+        if (free_slots != 0) {
+            return g * MAP_GROUP + __builtin_ctz(free_slots);
+        }
+        g = (g + step) & (groups - 1);
+    }
+}
+
+// Smallest capacity that holds size keys below the 7/8 load limit
+static size_t map_capacity_for(size_t size)
+{
+    size_t capacity = MAP_GROUP;
+    while (capacity / 8 * 7 < size) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Move every key into a fresh table of capacity slots, which also drops the deleted markers
+static void map_rehash(struct Map *m, size_t capacity)
+{
+    uint8_t *control = m->control;
+    struct MapSlot *slots = m->slots;
+    size_t old_capacity = m->capacity;
+
+    // Allocate first, the heap limit may stop the program here and the map has to stay whole
+    heap_reserve(capacity + capacity * sizeof(struct MapSlot));
+    uint8_t *new_control = heap_alloc(capacity, false, NULL);
+    struct MapSlot *new_slots = heap_alloc(capacity * sizeof(struct MapSlot), false, NULL);
+
+    m->capacity = capacity;
+    m->control = new_control;
+    m->slots = new_slots;
+    memset(m->control, MAP_EMPTY, capacity);
+    m->used = m->size;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (control[i] < MAP_EMPTY) {
+            uint64_t hash = map_hash(slots[i].key);
+            size_t j = map_find_free(m, hash);
+            m->control[j] = hash & 0x7F;
+            m->slots[j] = slots[i];
+        }
+    }
+
+    heap_release(control);
+    heap_release(slots);
+}
+
+static void free_map(void *object)
+{
+    struct Map *m = object;
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->control[i] < MAP_EMPTY) {
+            map_drop_key(m->slots[i].key);
+        }
+    }
+    heap_release(m->control);
+    heap_release(m->slots);
+}
+
+// Empty map with room for capacity keys before it grows
+static struct Map *new_map(size_t capacity)
+{
+    size_t slots = capacity > 0 ? map_capacity_for(capacity) : 0;
+    heap_reserve(sizeof(struct Map) + slots + slots * sizeof(struct MapSlot));
+    struct Map *m = heap_alloc(sizeof(struct Map), true, free_map);
+    if (slots > 0) {
+        map_rehash(m, slots);
+    }
+    return m;
+}
+
+// Make room for size keys in total so filling the map doesn't rehash along the way
+static void map_reserve(struct Map *m, size_t size)
+{
+    if (size > m->capacity / 8 * 7) {
+        map_rehash(m, map_capacity_for(size));
+    }
+}
+
+static bool map_get(struct Map const *m, struct MapKey key, uint64_t *value)
+{
+    ptrdiff_t i = map_find(m, key, map_hash(key));
+    if (i < 0) {
+        return false;
+    }
+    *value = m->slots[i].value;
+    return true;
+}
+
+// Set the value of key, the map takes over the reference to a string key
+static void map_put(struct Map *m, struct MapKey key, uint64_t value)
+{
+    uint64_t hash = map_hash(key);
+    ptrdiff_t i = map_find(m, key, hash);
+    if (i >= 0) {
+        m->slots[i].value = value;
+        map_drop_key(key);
+        return;
+    }
+
+    if (m->used + 1 > m->capacity / 8 * 7) {
+        // Mostly deleted slots are cleared out at the same size, otherwise the table doubles
+        map_rehash(m, map_capacity_for(m->size + 1 > m->capacity / 2 ? m->capacity * 2 : m->size + 1));
+    }
+
+    size_t j = map_find_free(m, hash);
+    m->used += m->control[j] == MAP_EMPTY;
+    m->size++;
+    m->control[j] = hash & 0x7F;
+    m->slots[j].key = key;
+    m->slots[j].value = value;
+}
+
+// Remove key, false if it wasn't there
+static bool map_delete(struct Map *m, struct MapKey key)
+{
+    ptrdiff_t i = map_find(m, key, map_hash(key));
+    if (i < 0) {
+        return false;
+    }
+
+    map_drop_key(m->slots[i].key);
+    m->size--;
+
+    // A group that still has an empty slot never sent a search further, so the slot can be
+    // empty again. Otherwise a deleted marker keeps searches for later keys going.
+    uint8_t *group = m->control + i / MAP_GROUP * MAP_GROUP;
+    if (map_match(group, MAP_EMPTY) != 0) {
+        m->control[i] = MAP_EMPTY;
+        m->used--;
+    } else {
+        m->control[i] = MAP_DELETED;
+    }
+    return true;
+}
+
+// Slot of the first key at or after *cursor, which moves past it. -1 once every key was seen.
+static ptrdiff_t map_next(struct Map const *m, size_t *cursor)
+{
+    size_t i = *cursor;
+    while (i < m->capacity) {
+        size_t g = i / MAP_GROUP * MAP_GROUP;
+        unsigned full = ~map_match_free(m->control + g) & (0xFFFFu << (i - g)) & 0xFFFF;
+        if (full != 0) {
+            i = g + __builtin_ctz(full);
+            *cursor = i + 1;
+            return i;
+        }
+        i = g + MAP_GROUP;
+    }
+    *cursor = m->capacity;
+    return -1;
+}
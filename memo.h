@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "map.h"
+#include "number.h"
+
+// Results of a memo fun keyed by its arguments. An argument tuple can only sit in the
+// MEMO_PROBE slots from its hash on, and once the table has reached MEMO_LIMIT slots a
+// new result that finds them all taken replaces the first, so a cache never grows
+// without bound and a lookup looks at no more than MEMO_PROBE slots.
+
+#define MEMO_INITIAL 64 // Slots of a fresh cache
+#define MEMO_LIMIT (1 << 16) // Most slots a cache grows to
+#define MEMO_PROBE 4 // Slots an argument tuple may use
+
+struct MemoEntry
+{
+    uint64_t hash; // Of the arguments, 0 marks an empty slot
+    uint64_t floats; // Bit i set if argument i is a float
+    uint64_t result;
+    number_kind kind; // Of the result
+};
+
+struct MemoCache
+{
+    pthread_mutex_t lock; // Parallel for workers call functions at the same time
+    size_t numArgs;
+    size_t capacity;
+    size_t size; // Slots in use
+    struct MemoEntry *entries;
+    uint64_t *args; // numArgs arguments per slot
+    size_t generation; // functionGeneration when the results were computed
+    bool pure; // Whether the function and everything it calls passed the purity check then
+    size_t hits;
+    size_t misses;
+    size_t evictions; // Results replaced by a different argument tuple
+};
+
+static struct MemoCache *new_memo(size_t numArgs)
+{
+    struct MemoCache *memo = calloc(1, sizeof(struct MemoCache));
+    pthread_mutex_init(&memo->lock, NULL);
+    memo->numArgs = numArgs;
+    memo->capacity = MEMO_INITIAL;
+    memo->entries = calloc(MEMO_INITIAL, sizeof(struct MemoEntry));
+    memo->args = calloc(MEMO_INITIAL * numArgs + 1, sizeof(uint64_t));
+    memo->pure = true;
+    return memo;
+}
+
+static void free_memo(struct MemoCache *memo)
+{
+    if (memo != NULL) {
+        pthread_mutex_destroy(&memo->lock);
+        free(memo->entries);
+        free(memo->args);
+        free(memo);
+    }
+}
+
+static uint64_t memo_hash(uint64_t const *args, size_t numArgs, uint64_t floats)
+{
+    uint64_t h = map_mix(floats ^ numArgs);
+    for (size_t i = 0; i < numArgs; i++) {
+        h = map_mix(h ^ args[i]);
+    }
+    return h != 0 ? h : 1;
+}
+
+// Forget every result, the statistics are kept
+static void memo_clear(struct MemoCache *memo)
+{
+    memset(memo->entries, 0, memo->capacity * sizeof(struct MemoEntry));
+    memo->size = 0;
+}
+
+static bool memo_matches(struct MemoCache const *memo, size_t i, uint64_t hash, uint64_t const *args, uint64_t floats)
+{
+    struct MemoEntry const *entry = &memo->entries[i];
+    return entry->hash == hash && entry->floats == floats &&
+           memcmp(memo->args + i * memo->numArgs, args, memo->numArgs * sizeof(uint64_t)) == 0;
+}
+
+// Slot holding args, or failing that the first empty slot they may use, or failing that
+// the first slot they may use. Slots after the last one wrap around to the start.
+static size_t memo_slot(struct MemoCache const *memo, uint64_t hash, uint64_t const *args, uint64_t floats)
+{
+    size_t home = hash & (memo->capacity - 1);
+    size_t empty = memo->capacity;
+    for (size_t p = 0; p < MEMO_PROBE; p++) {
+        size_t i = (home + p) & (memo->capacity - 1);
+        if (memo_matches(memo, i, hash, args, floats)) {
+            return i;
+        }
+        if (memo->entries[i].hash == 0 && empty == memo->capacity) {
+            empty = i;
+        }
+    }
+    return empty != memo->capacity ? empty : home;
+}
+
+static void memo_put(struct MemoCache *memo, uint64_t const *args, struct MemoEntry entry)
+{
+    size_t i = memo_slot(memo, entry.hash, args, entry.floats);
+    if (memo->entries[i].hash == 0) {
+        memo->size++;
+    } else if (!memo_matches(memo, i, entry.hash, args, entry.floats)) {
+        memo->evictions++;
+    }
+    memo->entries[i] = entry;
+    memcpy(memo->args + i * memo->numArgs, args, memo->numArgs * sizeof(uint64_t));
+}
+
+// Move the results into a table twice the size
+static void memo_grow(struct MemoCache *memo)
+{
+    struct MemoEntry *entries = memo->entries;
+    uint64_t *args = memo->args;
+    size_t capacity = memo->capacity;
+
+    memo->capacity = capacity * 2;
+    memo->entries = calloc(memo->capacity, sizeof(struct MemoEntry));
+    memo->args = calloc(memo->capacity * memo->numArgs + 1, sizeof(uint64_t));
+    memo->size = 0;
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (entries[i].hash != 0) {
+            memo_put(memo, args + i * memo->numArgs, entries[i]);
+        }
+    }
+
+    free(entries);
+    free(args);
+}
+
+// Result for args, false on a miss. Counts the hit or miss.
+static bool memo_lookup(struct MemoCache *memo, uint64_t const *args, uint64_t floats, uint64_t *result, number_kind *kind)
+{
+    uint64_t hash = memo_hash(args, memo->numArgs, floats);
+
+    pthread_mutex_lock(&memo->lock);
+    size_t i = memo_slot(memo, hash, args, floats);
+    bool found = memo_matches(memo, i, hash, args, floats);
+    if (found) {
+        *result = memo->entries[i].result;
+        *kind = memo->entries[i].kind;
+        memo->hits++;
+    } else {
+        memo->misses++;
+    }
+    pthread_mutex_unlock(&memo->lock);
+    return found;
+}
+
+static void memo_store(struct MemoCache *memo, uint64_t const *args, uint64_t floats, uint64_t result, number_kind kind)
+{
+    struct MemoEntry entry = {memo_hash(args, memo->numArgs, floats), floats, result, kind};
+
+    pthread_mutex_lock(&memo->lock);
+    if (memo->size >= memo->capacity / 2 && memo->capacity < MEMO_LIMIT) {
+        memo_grow(memo);
+    }
+    memo_put(memo, args, entry);
+    pthread_mutex_unlock(&memo->lock);
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+// Number types. uint64 is the plain integer, its arithmetic wraps around. The other integers
+// are signed or narrow: arithmetic on them is done on int64_t with overflow checks, and storing
+// into a narrow variable or array element checks the value fits. Narrow arrays are packed.
+// float64 is an IEEE double, stored as its bits wherever the integers keep their value.
+typedef enum {uint64, int64, int32, int16, int8, uint32, uint16, uint8, float64} number_kind;
+
+static char const *const number_kind_names[] = {"uint64", "int64", "int32", "int16", "int8", "uint32", "uint16", "uint8", "float"};
+
+#define NUMBER_KINDS (sizeof(number_kind_names) / sizeof(number_kind_names[0]))
+
+// Bytes per array element
+static size_t number_size(number_kind kind)
+{
+    static size_t const sizes[] = {8, 8, 4, 2, 1, 4, 2, 1, 8};
+    return sizes[kind];
+}
+
+// Values of every kind but uint64 are signed in expressions, the unsigned narrow kinds can't be negative anyway
+static bool number_signed(number_kind kind)
+{
+    return kind != uint64;
+}
+
+// Whether value, read as int64_t unless kind is uint64, can be stored in kind
+static bool number_fits(number_kind kind, uint64_t value)
+{
+    int64_t v = (int64_t) value;
+    switch (kind) {
+    case int32:
+        return v >= INT32_MIN && v <= INT32_MAX;
+    case int16:
+        return v >= INT16_MIN && v <= INT16_MAX;
+    case int8:
+        return v >= INT8_MIN && v <= INT8_MAX;
+    case uint32:
+        return value <= UINT32_MAX;
+    case uint16:
+        return value <= UINT16_MAX;
+    case uint8:
+        return value <= UINT8_MAX;
+    default:
+        return true;
+    }
+}
+
+// Element i of packed data, sign extended for the signed kinds
+static uint64_t number_load(void const *data, number_kind kind, size_t i)
+{
+    switch (kind) {
+    case int32:
+        return (int64_t) ((int32_t const *) data)[i];
+    case int16:
+        return (int64_t) ((int16_t const *) data)[i];
+    case int8:
+        return (int64_t) ((int8_t const *) data)[i];
+    case uint32:
+        return ((uint32_t const *) data)[i];
+    case uint16:
+        return ((uint16_t const *) data)[i];
+    case uint8:
+        return ((uint8_t const *) data)[i];
+    default:
+        return ((uint64_t const *) data)[i];
+    }
+}
+
+// Store value, which must fit kind, as element i of packed data
+static void number_store(void *data, number_kind kind, size_t i, uint64_t value)
+{
+    switch (kind) {
+    case int32:
+    case uint32:
+        ((uint32_t *) data)[i] = value;
+        break;
+    case int16:
+    case uint16:
+        ((uint16_t *) data)[i] = value;
+        break;
+    case int8:
+    case uint8:
+        ((uint8_t *) data)[i] = value;
+        break;
+    default:
+        ((uint64_t *) data)[i] = value;
+    }
+}
+
+// a op b on int64_t for + - * / %, false if the result overflows. Division by 0 gives 0 like the plain integers.
+static bool number_checked(char op, int64_t a, int64_t b, int64_t *result)
+{
+    switch (op) {
+    case '+':
+        return !__builtin_add_overflow(a, b, result);
+    case '-':
+        return !__builtin_sub_overflow(a, b, result);
+    case '*':
+        return !__builtin_mul_overflow(a, b, result);
+    default:
+        if (b == 0) {
+            *result = 0;
+            return true;
+        }
+        // INT64_MIN / -1 is the one quotient that doesn't fit, its remainder is 0
+        if (b == -1) {
+            *result = op == '/' && a != INT64_MIN ? -a : 0;
+            return op != '/' || a != INT64_MIN;
+        }
+        *result = op == '/' ? a / b : a % b;
+        return true;
+    }
+}
+
+// Value of an expression, the bits of a double if isFloat is set. Otherwise isSigned
+// tells whether the integer is an int64_t or a plain wrapping uint64_t.
+struct number
+{
+    uint64_t value;
+    bool isSigned;
+    bool isFloat;
+};
+
+// Value stored as kind, taking part in expressions
+static struct number number_of(uint64_t value, number_kind kind)
+{
+    return (struct number) {value, number_signed(kind), kind == float64};
+}
+
+static struct number number_from_double(double d)
+{
+    struct number v = {0, true, true};
+    memcpy(&v.value, &d, sizeof(d));
+    return v;
+}
+
+static double number_as_double(struct number v)
+{
+    if (v.isFloat) {
+        double d;
+        memcpy(&d, &v.value, sizeof(d));
+        return d;
+    }
+    return v.isSigned ? (double) (int64_t) v.value : (double) v.value;
+}
+
+// Kind a value keeps when it leaves an expression, for return values and parameters
+static number_kind number_kind_of(struct number v)
+{
+    return v.isFloat ? float64 : v.isSigned ? int64 : uint64;
+}
+
+// Whether v counts as true, 0.0 and -0.0 are both false
+static bool number_truthy(struct number v)
+{
+    return v.isFloat ? number_as_double(v) != 0 : v.value != 0;
+}
+
+// Bits to store v as kind, false if it doesn't fit. Doubles become integers by truncating toward zero.
+static bool number_convert(struct number v, number_kind kind, uint64_t *bits)
+{
+    if (kind == float64) {
+        *bits = number_from_double(number_as_double(v)).value;
+        return true;
+    }
+
+    if (v.isFloat) {
+        double d = number_as_double(v);
+        // Written so NaN fails too
+        if (!(d > -9223372036854775809.0 && d < (kind == uint64 ? 18446744073709551616.0 : 9223372036854775808.0))) {
+            return false;
+        }
+        *bits = d < 0 ? (uint64_t) (int64_t) d : (uint64_t) d;
+    } else {
+        *bits = v.value;
+    }
+    return number_fits(kind, *bits);
+}
+
+// Fewest digits from 15 to 17 that read back as the same double, with .0 added to whole numbers
+static int number_format_double(char *buffer, size_t size, double d)
+{
+    int n = 0;
+    for (int digits = 15; digits <= 17; digits++) {
+        n = snprintf(buffer, size, "%.*g", digits, d);
+        if (strtod(buffer, NULL) == d || d != d) {
+            break;
+        }
+    }
+    if (strpbrk(buffer, ".eni") == NULL) {
+        n += snprintf(buffer + n, size - n, ".0");
+    }
+    return n;
+}
+
+// Print v the way print shows it, buffer must hold at least 32 bytes
+static int number_format(char *buffer, size_t size, struct number v)
+{
+    if (v.isFloat) {
+        return number_format_double(buffer, size, number_as_double(v));
+    }
+    return snprintf(buffer, size, "%ld", v.value);
+}
@@ -13,8 +13,11 @@
 #include <pthread.h>
 
 #include "slice.h"
+#include "array.h"
+#include "view.h"
+#include "map.h"
 
-typedef enum {integer, boolean, string, array, thread, empty} variable_type;
+typedef enum {integer, boolean, string, array, thread, channel, view, map, empty} variable_type;
 
 struct data_type
 {
@@ -22,13 +25,53 @@ struct data_type
     char* ifString;
     uint64_t isInt;
     bool isBool;
-    struct data_type **isArray;
-    pthread_t thread_id;
+    struct Array *isArray;
+    struct Coroutine *isThread;
+    struct Channel *isChannel;
+    struct View isView;
+    struct Map *isMap;
+    number_kind numType; // Kind of an integer, uint64 for a plain one
 };
 
+// A stored value holds one reference to the heap object behind it
+static void retain_value(struct data_type const *value)
+{
+    if (value->curr_data_type == string) {
+        heap_retain(value->ifString);
+    } else if (value->curr_data_type == array) {
+        heap_retain(value->isArray);
+    } else if (value->curr_data_type == view) {
+        heap_retain(value->isView.file);
+    } else if (value->curr_data_type == channel) {
+        heap_retain(value->isChannel);
+    } else if (value->curr_data_type == thread) {
+        heap_retain(value->isThread);
+    } else if (value->curr_data_type == map) {
+        heap_retain(value->isMap);
+    }
+}
+
+static void release_value(struct data_type const *value)
+{
+    if (value->curr_data_type == string) {
+        heap_release(value->ifString);
+    } else if (value->curr_data_type == array) {
+        heap_release(value->isArray);
+    } else if (value->curr_data_type == view) {
+        heap_release(value->isView.file);
+    } else if (value->curr_data_type == channel) {
+        heap_release(value->isChannel);
+    } else if (value->curr_data_type == thread) {
+        heap_release(value->isThread);
+    } else if (value->curr_data_type == map) {
+        heap_release(value->isMap);
+    }
+}
+
 // Hashmap entries that store variables as slices w/ their associated value
 struct Pair
 {
     struct Slice key;
     struct data_type value;
+    bool shared; // Visible to every iteration of a parallel for, so it must not be assigned
 };
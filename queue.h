@@ -19,8 +19,9 @@ typedef struct Queue {
     struct Interpreter *tail;
 } Queue;
 
-void addQ(Queue* q, struct Interpreter* r) {
+static void addQ(Queue* q, struct Interpreter* r) {
     r->next = 0;
+    r->queued = q;
     if (q->tail != 0) {
         q->tail->next = r;
     }
@@ -31,13 +32,36 @@ void addQ(Queue* q, struct Interpreter* r) {
     }
 }
 
-struct Interpreter* removeQ(Queue* q) {
+static struct Interpreter* removeQ(Queue* q) {
     struct Interpreter* r = q->head;
     if (r != 0) {
         q->head = r->next;
         if (q->tail == r) {
             q->tail = 0;
         }
+        r->queued = NULL;
     }
     return r;
 }
+
+// Take r out of whichever queue it is in
+static void unlinkQ(struct Interpreter* r) {
+    Queue* q = r->queued;
+    if (q == NULL) {
+        return;
+    }
+
+    struct Interpreter* prev = 0;
+    for (struct Interpreter* p = q->head; p != r; p = p->next) {
+        prev = p;
+    }
+    if (prev == 0) {
+        q->head = r->next;
+    } else {
+        prev->next = r->next;
+    }
+    if (q->tail == r) {
+        q->tail = prev;
+    }
+    r->queued = NULL;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdnoreturn.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Errors and resource limits of a run. fail() unwinds to the recovery point of the thread with
+// a RunError instead of ending the process, so a host can run untrusted programs and go on after
+// one of them fails. Operations are counted at loop back-edges and calls from a thread-local
+// budget that is refilled from the shared one OPS_CHUNK at a time, which is also when the clock
+// is checked, so the limits cost a decrement and a compare on the hot path.
+
+#define OPS_CHUNK 1024 // Operations a thread takes from the shared budget at once
+
+typedef enum {error_none, error_runtime, error_ops, error_heap, error_depth, error_timeout} error_kind;
+
+static char const *const error_kind_names[] = {"ok", "error", "operation limit exceeded", "heap limit exceeded", "recursion depth limit exceeded", "timeout"};
+
+// What stopped a run
+struct RunError
+{
+    error_kind kind;
+    size_t line; // Where in the source, 0 if the error has no place in it
+    size_t column;
+    char *report; // Everything fail prints: location, the line with a caret and the calls that led there
+};
+
+// Limits of a run, 0 for no limit. The heap limit is in struct Heap, see heap.h.
+struct Limits
+{
+    uint64_t maxOps; // Loop iterations and calls
+    size_t maxDepth; // Nested function calls
+    uint64_t timeout; // Nanoseconds of wall-clock time
+};
+
+// Limits of a program and what its current run has left of them. Each program has its own, the
+// threads of its parallel fors share it.
+struct Sandbox
+{
+    struct Limits limits;
+    _Atomic uint64_t opsLeft; // Shared operation budget of the run
+    uint64_t deadline; // CLOCK_MONOTONIC time the run has to end by, when limits.timeout is set
+};
+
+static __thread int64_t opsBudget = 0; // Operations this thread may run before it takes more from opsLeft
+static __thread size_t callDepth = 0; // Function calls in progress on this thread
+
+static __thread jmp_buf *failTarget = NULL; // Recovery point errors unwind to, NULL to end the process instead
+static __thread struct RunError lastError; // Error being unwound to failTarget
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Start counting a run against the limits of sandbox
+static void limits_start(struct Sandbox *sandbox)
+{
+    atomic_store(&sandbox->opsLeft, sandbox->limits.maxOps);
+    sandbox->deadline = monotonic_ns() + sandbox->limits.timeout;
+    opsBudget = 0;
+    callDepth = 0;
+}
+
+// Refill opsBudget from sandbox after it went below 0, error_none or the limit that ran out
+static error_kind refill_ops(struct Sandbox *sandbox)
+{
+    if (sandbox->limits.timeout != 0 && monotonic_ns() > sandbox->deadline) {
+        return error_timeout;
+    }
+    if (sandbox->limits.maxOps == 0) {
+        // Only the clock has to be checked now and then
+        opsBudget = sandbox->limits.timeout != 0 ? OPS_CHUNK : INT64_MAX;
+        return error_none;
+    }
+
+    uint64_t owed = (uint64_t) -opsBudget; // Operations already run beyond the budget
+    uint64_t left = atomic_load(&sandbox->opsLeft);
+    uint64_t take;
+    do {
+        if (left < owed) {
+            atomic_store(&sandbox->opsLeft, 0);
+            return error_ops;
+        }
+        take = left - owed < OPS_CHUNK ? left : owed + OPS_CHUNK;
+    } while (!atomic_compare_exchange_weak(&sandbox->opsLeft, &left, left - take));
+
+    opsBudget += take;
+    return error_none;
+}
+
+// Unwind to the recovery point with error, or print its report and exit if there is none
+static noreturn void raise_error(struct RunError error)
+{
+    if (failTarget == NULL) {
+        fputs(error.report, stderr);
+        exit(1);
+    }
+    free(lastError.report);
+    lastError = error;
+    longjmp(*failTarget, 1);
+}
@@ -12,21 +12,21 @@ struct Slice
 };
 
 // First constructor
-struct Slice new_slice1(char const *const start, size_t const len)
+static struct Slice new_slice1(char const *const start, size_t const len)
 {
   struct Slice _slice = {start, len};
   return _slice;
 }
 
 // Second constructor
-struct Slice new_slice2(char const *const start, char const *const end)
+static struct Slice new_slice2(char const *const start, char const *const end)
 {
   struct Slice _slice = {start, (size_t)(end - start)};
   return _slice;
 }
 
 // Identify a slice
-bool is_identifier(struct Slice _slice)
+static bool is_identifier(struct Slice _slice)
 {
   char const *start = _slice.start;
   size_t len = _slice.len;
@@ -41,20 +41,8 @@ bool is_identifier(struct Slice _slice)
   return true;
 }
 
-// Print contents of slice struct in readable format
-void print_slice(struct Slice _slice)
-{
-  char const *const start = _slice.start;
-  size_t const len = _slice.len;
-
-  for (size_t i = 0; i < len; i++)
-  {
-    printf("%c", start[i]);
-  }
-}
-
 // Equals function for a Slice struct and character string
-extern const inline bool operator1(char const *p, struct Slice _slice)
+static const inline bool operator1(char const *p, struct Slice _slice)
 {
   char const *const start = _slice.start;
   size_t const len = _slice.len;
@@ -68,7 +56,7 @@ extern const inline bool operator1(char const *p, struct Slice _slice)
 }
 
 // Equals function for 2 Slice structs
-extern const bool operator2(const struct Slice other1, const struct Slice other2)
+static const bool operator2(const struct Slice other1, const struct Slice other2)
 {
   char const *const start1 = other1.start;
   size_t const len1 = other1.len;
@@ -84,7 +72,7 @@ extern const bool operator2(const struct Slice other1, const struct Slice other2
 }
 
 // Hash function for Slice struct
-size_t hash_function(struct Slice key)
+static size_t hash_function(struct Slice key)
 {
   size_t out = 5381;
   for (size_t i = 0; i < key.len; i++)
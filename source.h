@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Where a line starts in the source and its number, from 1
+struct SourceLine
+{
+    size_t offset;
+    size_t line;
+};
+
+// Bytes of source from start up to end
+struct SourceRange
+{
+    size_t start;
+    size_t end;
+};
+
+// Where the lines of the program source start, so an error can be reported as file:line:column.
+// The index is filled once as the source is mapped or read and only searched when reporting,
+// nothing keeps track of lines while the program runs. Every program has its own, see context.h.
+// A program streamed from a pipe drops the lines no code that can still run is in, see source_keep.
+struct SourceMap
+{
+    char const *name; // File name, or <stdin>
+    struct SourceLine *lines; // Lines that were kept, by where they start
+    size_t count;
+    size_t capacity;
+    size_t length; // Bytes of source added so far
+    size_t lineCount; // Lines of source added so far, kept or not
+};
+
+static void source_init(struct SourceMap *sourceMap, char const *name)
+{
+    sourceMap->name = name;
+    sourceMap->capacity = 64;
+    sourceMap->lines = malloc(sourceMap->capacity * sizeof(struct SourceLine));
+    sourceMap->lines[0] = (struct SourceLine) {0, 1};
+    sourceMap->count = 1;
+    sourceMap->length = 0;
+    sourceMap->lineCount = 1;
+}
+
+static void source_free(struct SourceMap *sourceMap)
+{
+    free(sourceMap->lines);
+    sourceMap->lines = NULL;
+}
+
+// Index the next length bytes of the source
+static void source_add(struct SourceMap *sourceMap, char const *text, size_t length)
+{
+    char const *end = text + length;
+    for (char const *p = text; (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        if (sourceMap->count == sourceMap->capacity) {
+            sourceMap->capacity *= 2;
+            sourceMap->lines = realloc(sourceMap->lines, sourceMap->capacity * sizeof(struct SourceLine));
+        }
+        sourceMap->lines[sourceMap->count++] = (struct SourceLine) {sourceMap->length + (p + 1 - text), ++sourceMap->lineCount};
+    }
+    sourceMap->length += length;
+}
+
+// Drop the lines that none of ranges, sorted by start, overlaps. Offsets in them can't be
+// located any more. The range of the last line added has to be one of them.
+__attribute__((unused))
+static void source_keep(struct SourceMap *sourceMap, struct SourceRange const *ranges, size_t rangeCount)
+{
+    size_t kept = 0;
+    size_t r = 0;
+    for (size_t i = 0; i < sourceMap->count; i++) {
+        size_t start = sourceMap->lines[i].offset;
+        size_t end = i + 1 < sourceMap->count ? sourceMap->lines[i + 1].offset : SIZE_MAX;
+
+        // Ranges that end before this line end before every later one too
+        while (r < rangeCount && ranges[r].end <= start) {
+            r++;
+        }
+        if (r < rangeCount && ranges[r].start < end) {
+            sourceMap->lines[kept++] = sourceMap->lines[i];
+        }
+    }
+    sourceMap->count = kept;
+}
+
+// Line and column, both from 1, of a byte offset into the source
+static void source_locate(struct SourceMap const *sourceMap, size_t offset, size_t *line, size_t *column)
+{
+    // Last line that starts at or before offset
+    size_t low = 0;
+    size_t high = sourceMap->count;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (sourceMap->lines[mid].offset <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    *line = sourceMap->lines[low].line;
+    *column = offset - sourceMap->lines[low].offset + 1;
+}
+
+// Print name:line:column for a byte offset into the source
+static void source_print_location(struct SourceMap const *sourceMap, FILE *out, size_t offset)
+{
+    size_t line;
+    size_t column;
+    source_locate(sourceMap, offset, &line, &column);
+    fprintf(out, "%s:%zu:%zu", sourceMap->name, line, column);
+}
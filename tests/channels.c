@@ -0,0 +1,107 @@
+// The workers of a parallel for wake coroutines that sleep on channels while the loop runs.
+// Two workers sending on different channels at the same moment must not both touch the queue
+// of ready coroutines, which this checks under ThreadSanitizer. A worker waiting for a value
+// only a coroutine would send fails instead of waiting forever, coroutines don't run until the
+// loop is done.
+//
+//     gcc -O1 -g -fsanitize=thread -I. -o channels tests/channels.c fun.c -lm -pthread
+//     ./channels
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fun.h"
+
+char const *const script =
+    "channel a[64]\n"
+    "channel b[64]\n"
+    "channel c[2]\n"
+    "fun takeA(n) {\n"
+    "    integer s = 0\n"
+    "    integer x = 0\n"
+    "    for (integer i = 0; i < n; i = i + 1) {\n"
+    "        recv(a, x)\n"
+    "        s = s + x\n"
+    "    }\n"
+    "    return s\n"
+    "}\n"
+    "fun takeB(n) {\n"
+    "    integer s = 0\n"
+    "    integer x = 0\n"
+    "    for (integer i = 0; i < n; i = i + 1) {\n"
+    "        recv(b, x)\n"
+    "        s = s + x\n"
+    "    }\n"
+    "    return s\n"
+    "}\n"
+    "fun run(n) {\n"
+    "    thread p = spawn takeA(n)\n"
+    "    thread q = spawn takeB(n)\n"
+    "    yield()\n"
+    "    parallel for(integer i = 0; i < n; i = i + 1) {\n"
+    "        send(a, i)\n"
+    "        send(b, i)\n"
+    "    }\n"
+    "    return join(p) + join(q)\n"
+    "}\n"
+    "fun feed(n) {\n"
+    "    for (integer i = 0; i < n; i = i + 1) {\n"
+    "        send(c, i)\n"
+    "    }\n"
+    "    return 0\n"
+    "}\n"
+    "fun starve(n) {\n"
+    "    thread p = spawn feed(n)\n"
+    "    parallel for(integer i = 0; i < n; i = i + 1) {\n"
+    "        integer x = 0\n"
+    "        recv(c, x)\n"
+    "    }\n"
+    "    return join(p)\n"
+    "}\n";
+
+int main()
+{
+    fun_context *ctx = fun_new("channels.fun");
+    int failures = 0;
+
+    if (fun_compile(ctx, script) != FUN_OK)
+    {
+        fputs(fun_error(ctx, NULL, NULL), stdout);
+        failures++;
+    }
+
+    fun_value n = fun_int(64);
+    fun_value result;
+
+    for (int round = 0; round < 200 && failures == 0; round++)
+    {
+        fun_status status = fun_call(ctx, "run", &n, 1, &result);
+        if (status != FUN_OK || result.i != 2 * (63 * 64 / 2))
+        {
+            printf("round %d: status %d, result %ld\n", round, status, (long) result.i);
+            failures++;
+        }
+    }
+
+    if (failures == 0)
+    {
+        fun_status status = fun_call(ctx, "starve", &n, 1, &result);
+        char const *report = fun_error(ctx, NULL, NULL);
+        if (status != FUN_ERROR || strstr(report, "waits on a channel") == NULL)
+        {
+            printf("starve: status %d\n%s", status, report);
+            failures++;
+        }
+
+        // The context is still good for the next call
+        if (fun_call(ctx, "run", &n, 1, &result) != FUN_OK || result.i != 2 * (63 * 64 / 2))
+        {
+            printf("run after starve: %s", fun_error(ctx, NULL, NULL));
+            failures++;
+        }
+    }
+
+    fun_free(ctx);
+    puts(failures == 0 ? "ok" : "FAILED");
+    return failures != 0;
+}
@@ -0,0 +1,52 @@
+// Every iteration of a parallel for declares the arrays and maps of its body afresh, also when
+// a worker runs many iterations because there are more of them than cores.
+//
+//     gcc -O2 -I. -o parallel tests/parallel.c fun.c -lm -pthread
+//     ./parallel
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "fun.h"
+
+char const *const script =
+    "fun squares(n) {\n"
+    "    integer out[n]\n"
+    "    parallel for(integer i = 0; i < n; i = i + 1) {\n"
+    "        integer parts[0]\n"
+    "        map seen[4]\n"
+    "        integer twice = i * 2\n"
+    "        push(parts, i)\n"
+    "        push(parts, twice - i)\n"
+    "        seen[i] = parts[0] * parts[1]\n"
+    "        out[i] = seen[i] + len(parts) - 2\n"
+    "    }\n"
+    "    return sum(out)\n"
+    "}\n";
+
+int main()
+{
+    fun_context *ctx = fun_new("parallel.fun");
+    int failures = 0;
+
+    if (fun_compile(ctx, script) != FUN_OK)
+    {
+        fputs(fun_error(ctx, NULL, NULL), stdout);
+        failures++;
+    }
+
+    int64_t n = 8 * sysconf(_SC_NPROCESSORS_ONLN) + 3;
+    fun_value count = fun_int(n);
+    fun_value result;
+    fun_status status = fun_call(ctx, "squares", &count, 1, &result);
+
+    if (status != FUN_OK || result.i != (n - 1) * n * (2 * n - 1) / 6)
+    {
+        printf("status %d, result %ld\n%s", status, (long) result.i, status != FUN_OK ? fun_error(ctx, NULL, NULL) : "");
+        failures++;
+    }
+
+    fun_free(ctx);
+    puts(failures == 0 ? "ok" : "FAILED");
+    return failures != 0;
+}
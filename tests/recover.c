@@ -0,0 +1,127 @@
+// A context has to keep working after calls that fail partway through. Every failure below
+// leaves arrays behind in the frames it unwinds past, under a heap limit that a few hundred
+// leaked arrays would use up.
+//
+//     gcc -O2 -I. -o recover tests/recover.c fun.c -lm -pthread
+//     ./recover
+
+#include <stdio.h>
+
+#include "fun.h"
+
+char const *const script =
+    "fun fill(n) {\n"
+    "    integer a[0]\n"
+    "    for (integer i = 0; i < n; i = i + 1) {\n"
+    "        push(a, i)\n"
+    "    }\n"
+    "    return len(a)\n"
+    "}\n"
+    "fun nested(n) {\n"
+    "    integer b[1000]\n"
+    "    return fill(n)\n"
+    "}\n"
+    "fun deep(n) {\n"
+    "    integer c[100]\n"
+    "    return deep(n + 1)\n"
+    "}\n"
+    "fun deeper(n) {\n"
+    "    thread t = spawn deep(n)\n"
+    "    return join(t)\n"
+    "}\n"
+    "fun spin() {\n"
+    "    integer d[1000]\n"
+    "    while (true) {\n"
+    "    }\n"
+    "}\n"
+    "fun broken(n) {\n"
+    "    integer e[1000]\n"
+    "    return n / zz\n"
+    "}\n"
+    "fun awaitBroken(n) {\n"
+    "    thread t = spawn broken(n)\n"
+    "    return join(t)\n"
+    "}\n"
+    "fun talk(n) {\n"
+    "    string s = \"n is \" + n + \" of \" + (n / zz)\n"
+    "    return 0\n"
+    "}\n"
+    "fun poke(n) {\n"
+    "    integer f[10]\n"
+    "    f[n] = f[n - 1]\n"
+    "    return 0\n"
+    "}\n"
+    "fun shout(n) {\n"
+    "    print \"n is \" + n + \" of \" + (n / zz)\n"
+    "    return 0\n"
+    "}\n";
+
+int failures = 0;
+
+void expect(char const *what, fun_status status, fun_status expected)
+{
+    if (status != expected)
+    {
+        printf("%s: status %d, expected %d\n", what, status, expected);
+        failures++;
+    }
+}
+
+int main()
+{
+    fun_context *ctx = fun_new("recover.fun");
+    expect("compile", fun_compile(ctx, script), FUN_OK);
+
+    fun_value big = fun_int(1000000);
+    fun_value one = fun_int(1);
+    fun_value result;
+
+    for (int round = 0; round < 200; round++)
+    {
+        fun_set_limits(ctx, 0, 0, 1 << 20, 0);
+        expect("nested", fun_call(ctx, "nested", &big, 1, &result), FUN_HEAP_LIMIT);
+
+        // The heap limit is reported at the push that passed it, like any other error
+        size_t line = 0;
+        size_t column = 0;
+        fun_error(ctx, &line, &column);
+        if (line != 4)
+        {
+            printf("nested: heap limit reported at %zu:%zu\n", line, column);
+            failures++;
+        }
+        expect("broken", fun_call(ctx, "broken", &one, 1, &result), FUN_ERROR);
+        expect("awaitBroken", fun_call(ctx, "awaitBroken", &one, 1, &result), FUN_ERROR);
+        expect("talk", fun_call(ctx, "talk", &one, 1, &result), FUN_ERROR);
+        expect("poke", fun_call(ctx, "poke", &big, 1, &result), FUN_ERROR);
+        expect("shout", fun_call(ctx, "shout", &one, 1, &result), FUN_ERROR);
+
+        fun_set_limits(ctx, 0, 100, 1 << 20, 0);
+        expect("deep", fun_call(ctx, "deep", &one, 1, &result), FUN_DEPTH_LIMIT);
+
+        fun_set_limits(ctx, 10000, 0, 1 << 20, 0);
+        expect("spin", fun_call(ctx, "spin", NULL, 0, &result), FUN_OPS_LIMIT);
+    }
+
+    // Without a depth limit recursion stops where the stack, of the thread or of a coroutine, runs out
+    fun_set_limits(ctx, 0, 0, 0, 0);
+    for (int round = 0; round < 5; round++)
+    {
+        expect("deep unlimited", fun_call(ctx, "deep", &one, 1, &result), FUN_DEPTH_LIMIT);
+        expect("deeper", fun_call(ctx, "deeper", &one, 1, &result), FUN_DEPTH_LIMIT);
+    }
+
+    // Nearly all of the limit is free again
+    fun_set_limits(ctx, 0, 0, 1 << 20, 0);
+    fun_value most = fun_int(50000);
+    expect("fill", fun_call(ctx, "fill", &most, 1, &result), FUN_OK);
+    if (result.i != 50000)
+    {
+        printf("fill: %ld\n", (long) result.i);
+        failures++;
+    }
+
+    fun_free(ctx);
+    puts(failures == 0 ? "ok" : "FAILED");
+    return failures != 0;
+}
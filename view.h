@@ -0,0 +1,180 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "slice.h"
+#include "heap.h"
+
+#define VIEW_RELEASE_CHUNK (8 << 20) // Pages behind a line cursor are dropped this many bytes at a time
+
+// File mapped read only by mapFile. Every view into it holds a reference and it is
+// unmapped with the last one; pages only take memory while they are being read.
+struct MappedFile
+{
+    char const *data;
+    size_t length;
+};
+
+static void unmap_file(void *object)
+{
+    struct MappedFile *file = object;
+    if (file->data != NULL) {
+        munmap((void *) file->data, file->length);
+    }
+}
+
+// Read-only window into a mapped file. A view that has handed out its last field
+// has a NULL start, which tells it apart from one that still holds an empty field.
+struct View
+{
+    struct Slice text;
+    struct MappedFile *file;
+};
+
+// Point view at the file source belongs to, moving its reference over
+static void share_file(struct View *view, struct View const *source)
+{
+    if (view->file != source->file) {
+        heap_retain(source->file);
+        heap_release(view->file);
+        view->file = source->file;
+    }
+}
+
+// Map path read only, false with errno set on failure
+static bool map_file(char const *path, struct View *view)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stats;
+    if (fstat(fd, &file_stats) < 0) {
+        close(fd);
+        return false;
+    }
+
+    struct MappedFile *file = heap_alloc(sizeof(struct MappedFile), true, unmap_file);
+    file->length = file_stats.st_size;
+
+    // mmap can't map an empty file, an empty view needs no memory anyway
+    if (file->length > 0) {
+        void *data = mmap(0, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            heap_release(file);
+            return false;
+        }
+        madvise(data, file->length, MADV_SEQUENTIAL);
+        file->data = data;
+    }
+    close(fd);
+
+    view->text = new_slice1(file->data != NULL ? file->data : "", file->length);
+    view->file = file;
+    return true;
+}
+
+// Drop the pages a cursor moved past so a long scan uses constant memory.
+// They are read back from the file if another view still looks at them.
+static void release_behind(struct View const *view, char const *from, char const *to)
+{
+    struct MappedFile const *file = view->file;
+    if (file == NULL || file->data == NULL) {
+        return;
+    }
+
+    size_t first = (from - file->data) / VIEW_RELEASE_CHUNK;
+    size_t last = (to - file->data) / VIEW_RELEASE_CHUNK;
+    if (last > first) {
+        madvise((void *) (file->data + first * VIEW_RELEASE_CHUNK), (last - first) * VIEW_RELEASE_CHUNK, MADV_DONTNEED);
+    }
+}
+
+// Move the first line of source, without its line ending, into line. False once source is empty.
+static bool view_next_line(struct View *source, struct View *line)
+{
+    if (source->text.len == 0) {
+        return false;
+    }
+
+    char const *start = source->text.start;
+    char const *newline = memchr(start, '\n', source->text.len);
+    size_t length = newline != NULL ? (size_t) (newline - start) : source->text.len;
+    size_t skip = newline != NULL ? length + 1 : length;
+
+    share_file(line, source);
+    line->text = new_slice1(start, length > 0 && start[length - 1] == '\r' ? length - 1 : length);
+
+    source->text = new_slice1(start + skip, source->text.len - skip);
+    release_behind(source, start, source->text.start);
+    return true;
+}
+
+// Move the text of source up to the next separator into field. False once every field was taken.
+static bool view_next_field(struct View *source, struct View *field, char separator)
+{
+    if (source->text.start == NULL) {
+        return false;
+    }
+
+    char const *start = source->text.start;
+    char const *end = memchr(start, separator, source->text.len);
+
+    share_file(field, source);
+    if (end == NULL) {
+        field->text = source->text;
+        source->text = new_slice1(NULL, 0);
+    } else {
+        field->text = new_slice2(start, end);
+        source->text = new_slice1(end + 1, source->text.len - (end + 1 - start));
+    }
+    return true;
+}
+
+// Decimal integer at the start of text after any blanks, negative numbers wrap around
+static uint64_t view_to_int(struct Slice text)
+{
+    size_t i = 0;
+    while (i < text.len && isspace(text.start[i])) {
+        i++;
+    }
+
+    bool negative = i < text.len && text.start[i] == '-';
+    i += negative;
+
+    uint64_t value = 0;
+    while (i < text.len && isdigit(text.start[i])) {
+        value = value * 10 + (text.start[i] - '0');
+        i++;
+    }
+    return negative ? -value : value;
+}
+
+// Position of the first occurrence of needle in text, text.len if there is none
+static size_t view_find(struct Slice text, char const *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return 0;
+    }
+
+    char const *p = text.start;
+    char const *end = text.start + text.len;
+    while ((size_t) (end - p) >= needle_len) {
+        p = memchr(p, needle[0], end - p - needle_len + 1);
+        if (p == NULL) {
+            break;
+        }
+        if (memcmp(p, needle, needle_len) == 0) {
+            return p - text.start;
+        }
+        p++;
+    }
+    return text.len;
+}